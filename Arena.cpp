@@ -1,123 +1,1156 @@
 // local:
 #include "Arena.hpp"
+#include "Chemistry.hpp"
+#include "Trace.hpp"
 
 // stdlib
 #include <limits.h>
+#include <math.h>
 
 // STL:
 #include <stdexcept>
 #include <algorithm>
+#include <limits>
 using namespace std;
 
+const int ArenaBase::MAX_BONDS;
+const ArenaBase::AtomIndex ArenaBase::MAX_ATOMS;
+const ArenaBase::AtomIndex ArenaBase::NO_CLUSTER;
+template<class Geometry> const int ArenaT<Geometry>::INLINE_BONDS;
+template<class Geometry> const ArenaBase::AtomIndex ArenaT<Geometry>::NO_GROUP;
+
 //----------------------------------------------------------------------------
 
-Arena::Arena(int x, int y)
-    : X( x )
-	, Y( y )
-    , movement_method( MovementMethod::MPEGMolecules )
+static const int KINETIC_DX[4] = {  0,  1,  0, -1 }; // the von Neumann moves, clockwise from North
+static const int KINETIC_DY[4] = { -1,  0,  1,  0 };
+static const uint32_t NOT_FEASIBLE = UINT32_MAX;
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+ArenaT<Geometry>::ArenaT(int x, int y, MovementMethod method)
+    : geometry( x, y )
+    , kinetic_moves_valid( false )
+    , kinetic_time( 0.0 )
+    , next_generation( 1 )
+    , spatial_sort_interval( 0 )
+    , num_updates( 0 )
+    , num_type_classes( 0 )
+    , movable_first_row( 0 )
+    , movable_end_row( y )
+    , squared_displacement_sum( 0 )
+    , movement_method( method )
     , movement_neighborhood( Neighborhood::vonNeumann ) // currently only vonNeumann supported
     , chemical_neighborhood( Neighborhood::vonNeumann )
 {
-	this->grid = vector<vector<Slot>>( X, vector<Slot>( Y ) );
+    if( x - 1 > numeric_limits<Coordinate>::max() || y - 1 > numeric_limits<Coordinate>::max() )
+        throw out_of_range("Arena too large for the coordinate type, build with GRID_PHYSICS_WIDE_COORDINATES");
+    this->occupied.assign( size_t( x ) * y, 0 );
+    this->cell_atom.assign( size_t( x ) * y, 0 );
+    this->groups = make_shared<vector<Group>>();
+    fill_n( this->bond_range_count, Moore2 + 1, size_t( 0 ) );
+    setChemistry( Chemistry::getDefault() );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::hasAtom( int x, int y ) const {
+    if( isOffGrid(x,y ) )
+		throw out_of_range("Atom not on grid");
+
+    return this->occupied[ getCell( x, y ) ];
+}
+    
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+size_t ArenaT<Geometry>::addAtom( int x, int y, int type ) {
+
+    if( isOffGrid(x,y ) )
+		throw out_of_range("Atom not on grid");
+
+	const size_t cell = getCell( x, y );
+	if( this->occupied[ cell ] )
+		throw invalid_argument("Grid already contains an atom at that position");
+    if( type < 0 || type > numeric_limits<uint8_t>::max() )
+        throw out_of_range("Atom type out of range");
+
+    AtomIndex iAtom;
+    if( !this->free_atoms.empty() ) {
+        // reuse the slot of a removed atom
+        iAtom = this->free_atoms.back();
+        this->free_atoms.pop_back();
+    }
+    else {
+        if( getNumberOfAtoms() > MAX_ATOMS )
+            throw length_error("Too many atoms");
+        iAtom = AtomIndex( getNumberOfAtoms() );
+        this->atom_x.push_back( 0 );
+        this->atom_y.push_back( 0 );
+        this->origin_x.push_back( 0 );
+        this->origin_y.push_back( 0 );
+        this->atom_type.push_back( 0 );
+        this->num_bonds.push_back( 0 );
+        this->bonds.push_back( BondSlots() );
+        this->atom_generation.push_back( 0 );
+        this->borrowable.push_back( 0 );
+        this->rigid_cluster.push_back( NO_CLUSTER );
+        this->atom_group.push_back( NO_GROUP );
+        this->atom_molecule.push_back( NO_CLUSTER );
+    }
+    this->atom_x[ iAtom ] = Coordinate( x );
+    this->atom_y[ iAtom ] = Coordinate( y );
+    this->origin_x[ iAtom ] = Coordinate( x );
+    this->origin_y[ iAtom ] = Coordinate( y );
+    this->atom_type[ iAtom ] = uint8_t( type );
+    this->num_bonds[ iAtom ] = 0;
+    this->atom_generation[ iAtom ] = getNewGeneration();
+    this->borrowable[ iAtom ] = 0;
+    this->rigid_cluster[ iAtom ] = NO_CLUSTER;
+    this->atom_molecule[ iAtom ] = NO_CLUSTER;
+
+    this->occupied[ cell ] = true;
+    this->cell_atom[ cell ] = iAtom;
+
+	Group group;
+	group.atoms.push_back( iAtom );
+	getWritableGroups().push_back( group );
+    this->atom_group[ iAtom ] = hasSingleGroups() ? AtomIndex( getGroups().size() - 1 ) : NO_GROUP;
+    countMolecule( 1, +1 );
+    if( this->kinetic_moves_valid ) {
+        this->kinetic_groups.push_back( KineticGroup() );
+        addKineticMoves( getGroups().size() - 1 );
+        updateKineticMovesAround( x, y );
+    }
+
+	return iAtom;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::makeBond( size_t a, size_t b, Neighborhood range ) {
+    checkNewBond( a, b, range );
+
+    addBondTo( AtomIndex( a ), AtomIndex( b ), range );
+    addBondTo( AtomIndex( b ), AtomIndex( a ), range );
+    this->bond_range_count[ range ]++;
+    if( range == Neighborhood::vonNeumann )
+        joinRigidClusters( AtomIndex( a ), AtomIndex( b ) );
+    if( !hasMolecules() )
+        joinMolecules( AtomIndex( a ), AtomIndex( b ) );
+
+    switch( this->movement_method ) {
+        case JustAtoms:
+            // here we can never move atoms with von Neumann bonds so
+            // we can remove any groups with them in
+            if( range == Neighborhood::vonNeumann ) {
+                removeGroupOf( AtomIndex( a ) );
+                removeGroupOf( AtomIndex( b ) );
+            }
+            break;
+        case AllGroups:
+            //  we need to find all the subgraphs created by this new bond
+	        addAllGroupsForNewBond( a, b );
+            // if a and b are rigidly bonded then we don't need to check their groups separately
+            if( range == Neighborhood::vonNeumann )
+                removeGroupsWithOneButNotTheOther( a, b );
+            break;
+        case MPEGSpace: 
+            // we don't use groups for this method
+            break;
+        case MPEGMolecules: 
+        case MPEGSections: 
+        case KineticSections: 
+            // here each molecule is a single group (with its kinetic moves, if any, brought up to date)
+            combineGroupsInvolvingTheseIntoOne( a, b );
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::checkNewBond( size_t a, size_t b, Neighborhood range ) const {
+	if( a < 0 || a >= getNumberOfAtoms() || b < 0 || b >= getNumberOfAtoms() )
+		throw out_of_range("Invalid atom index");
+	if( a == b )
+		throw invalid_argument("Cannot bond atom to itself");
+    if( !isLiveAtom( a ) || !isLiveAtom( b ) )
+        throw invalid_argument("Cannot bond a removed atom");
+    if( !isWithinNeighborhood( range, this->atom_x[a], this->atom_y[a], this->atom_x[b], this->atom_y[b] ) )
+        throw invalid_argument("Atoms are too far apart to be bonded");
+    if( hasBond( AtomIndex( a ), AtomIndex( b ) ) )
+        throw invalid_argument("Atoms are already bonded");
+    if( this->num_bonds[ a ] == MAX_BONDS || this->num_bonds[ b ] == MAX_BONDS )
+        throw invalid_argument("Atom cannot hold any more bonds");
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+size_t ArenaT<Geometry>::addAtoms( const vector<AtomSpec>& specs ) {
+    // validate everything first, claiming the slots as we go so that duplicates are caught
+    for( size_t i = 0; i < specs.size(); ++i ) {
+        const AtomSpec& spec = specs[ i ];
+        const char *error = NULL;
+        if( isOffGrid( spec.x, spec.y ) )
+            error = "Atom not on grid";
+        else if( spec.type < 0 || spec.type > numeric_limits<uint8_t>::max() )
+            error = "Atom type out of range";
+        else if( this->occupied[ getCell( spec.x, spec.y ) ] )
+            error = "Grid already contains an atom at that position";
+        else if( getNumberOfAtoms() + i > MAX_ATOMS )
+            error = "Too many atoms";
+        if( error ) {
+            for( size_t j = 0; j < i; ++j )
+                this->occupied[ getCell( specs[ j ].x, specs[ j ].y ) ] = false;
+            throw invalid_argument( error );
+        }
+        this->occupied[ getCell( spec.x, spec.y ) ] = true;
+    }
+
+    // the new atoms are appended, without reusing free slots, so that their indices are consecutive
+    const size_t first = getNumberOfAtoms();
+    const size_t num_atoms = first + specs.size();
+    this->atom_x.resize( num_atoms );
+    this->atom_y.resize( num_atoms );
+    this->origin_x.resize( num_atoms );
+    this->origin_y.resize( num_atoms );
+    this->atom_type.resize( num_atoms );
+    this->num_bonds.resize( num_atoms, 0 );
+    this->bonds.resize( num_atoms );
+    this->atom_generation.resize( num_atoms );
+    this->borrowable.resize( num_atoms, 0 );
+    this->rigid_cluster.resize( num_atoms, NO_CLUSTER );
+    this->atom_group.resize( num_atoms, NO_GROUP );
+    this->atom_molecule.resize( num_atoms, NO_CLUSTER );
+    getWritableGroups().reserve( getWritableGroups().size() + specs.size() );
+    for( size_t i = 0; i < specs.size(); ++i ) {
+        const AtomIndex iAtom = AtomIndex( first + i );
+        this->atom_x[ iAtom ] = Coordinate( specs[ i ].x );
+        this->atom_y[ iAtom ] = Coordinate( specs[ i ].y );
+        this->origin_x[ iAtom ] = Coordinate( specs[ i ].x );
+        this->origin_y[ iAtom ] = Coordinate( specs[ i ].y );
+        this->atom_type[ iAtom ] = uint8_t( specs[ i ].type );
+        this->atom_generation[ iAtom ] = getNewGeneration();
+        this->cell_atom[ getCell( specs[ i ].x, specs[ i ].y ) ] = iAtom;
+        Group group;
+        group.atoms.push_back( iAtom );
+        getWritableGroups().push_back( group );
+        if( hasSingleGroups() )
+            this->atom_group[ iAtom ] = AtomIndex( getGroups().size() - 1 );
+    }
+    countMolecule( 1, int( specs.size() ) );
+    this->kinetic_moves_valid = false;
+    return first;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::addBonds( const vector<BondSpec>& specs ) {
+    if( specs.empty() )
+        return; // (bringing the groups up to date can cost a pass over the world)
+    // add the bonds, undoing them all if any turns out to be invalid
+    for( size_t i = 0; i < specs.size(); ++i ) {
+        try {
+            checkNewBond( specs[ i ].a, specs[ i ].b, specs[ i ].range );
+        }
+        catch( ... ) {
+            for( size_t j = i; j-- > 0; ) {
+                removeBondTo( AtomIndex( specs[ j ].a ), AtomIndex( specs[ j ].b ) );
+                removeBondTo( AtomIndex( specs[ j ].b ), AtomIndex( specs[ j ].a ) );
+            }
+            throw;
+        }
+        addBondTo( AtomIndex( specs[ i ].a ), AtomIndex( specs[ i ].b ), specs[ i ].range );
+        addBondTo( AtomIndex( specs[ i ].b ), AtomIndex( specs[ i ].a ), specs[ i ].range );
+    }
+    for( const BondSpec& spec : specs ) {
+        this->bond_range_count[ spec.range ]++;
+        if( spec.range == Neighborhood::vonNeumann )
+            joinRigidClusters( AtomIndex( spec.a ), AtomIndex( spec.b ) );
+        if( !hasMolecules() )
+            joinMolecules( AtomIndex( spec.a ), AtomIndex( spec.b ) );
+    }
+    this->kinetic_moves_valid = false;
+
+    // then bring the groups up to date in one go
+    switch( this->movement_method ) {
+        case JustAtoms:
+            removeGroupsOfRigidlyBondedAtoms();
+            break;
+        case AllGroups:
+            // there's no shortcut to finding all the subgraphs
+            for( const BondSpec& spec : specs ) {
+	            addAllGroupsForNewBond( AtomIndex( spec.a ), AtomIndex( spec.b ) );
+                if( spec.range == Neighborhood::vonNeumann )
+                    removeGroupsWithOneButNotTheOther( AtomIndex( spec.a ), AtomIndex( spec.b ) );
+            }
+            break;
+        case MPEGSpace:
+            // we don't use groups for this method
+            break;
+        case MPEGMolecules:
+        case MPEGSections:
+        case KineticSections:
+            rebuildMolecules();
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::removeGroupsOfRigidlyBondedAtoms() {
+    // (only singleton groups exist when atoms move individually)
+
+    class GroupIsRigidlyBonded {
+        public:
+            GroupIsRigidlyBonded( const ArenaT& arena ) : arena(arena) {}
+            bool operator() (const Group& g) const
+            {
+                for( const Bond& bond : arena.getBonds( g.atoms.front() ) ) {
+                    if( bond.range == Neighborhood::vonNeumann )
+                        return true;
+                }
+                return false;
+            }
+        private:
+            const ArenaT& arena;
+    };
+
+    vector<Group>& groups = getWritableGroups();
+    groups.erase( remove_if( begin( groups ), end( groups ),
+        GroupIsRigidlyBonded( *this ) ), end( groups ) );
+    indexGroups();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::rebuildMolecules() {
+    TRACE_SCOPE("rebuildMolecules");
+    findMolecules( getWritableGroups() );
+    this->molecule_size_count.clear();
+    for( const Group& group : getGroups() )
+        countMolecule( group.atoms.size(), +1 );
+    indexGroups();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::indexGroups() {
+    // (see hasSingleGroups)
+    for( size_t iAtom = 0; iAtom < getNumberOfAtoms(); ++iAtom )
+        this->atom_group[ iAtom ] = NO_GROUP;
+    for( size_t iGroup = 0; iGroup < getGroups().size(); ++iGroup ) {
+        for( const AtomIndex& iAtom : getGroups()[ iGroup ].atoms )
+            this->atom_group[ iAtom ] = AtomIndex( iGroup );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::findMolecules( vector<Group>& molecules ) const {
+    // each connected set of live atoms becomes a group, with its members in ascending order
+    molecules.clear();
+    vector<bool> visited( getNumberOfAtoms(), false );
+    vector<AtomIndex> to_visit;
+    for( size_t iAtom = 0; iAtom < getNumberOfAtoms(); ++iAtom ) {
+        if( !isLiveAtom( iAtom ) || visited[ iAtom ] )
+            continue;
+        Group group;
+        visited[ iAtom ] = true;
+        to_visit.push_back( AtomIndex( iAtom ) );
+        while( !to_visit.empty() ) {
+            const AtomIndex i = to_visit.back();
+            to_visit.pop_back();
+            group.atoms.push_back( i );
+            for( const Bond& bond : getBonds( i ) ) {
+                if( visited[ bond.iAtom ] )
+                    continue;
+                visited[ bond.iAtom ] = true;
+                to_visit.push_back( bond.iAtom );
+            }
+        }
+        sort( begin( group.atoms ), end( group.atoms ) );
+        molecules.push_back( group );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::hasMolecules() const {
+    // (for these methods each group is a molecule)
+    return this->movement_method == MPEGMolecules || this->movement_method == MPEGSections || this->movement_method == KineticSections;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::hasSingleGroups() const {
+    // (for these methods each atom is in at most one group, which atom_group keeps track of)
+    return this->movement_method == JustAtoms || hasMolecules();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::countMolecule( size_t size, int change ) {
+    if( size >= this->molecule_size_count.size() )
+        this->molecule_size_count.resize( size + 1, 0 );
+    this->molecule_size_count[ size ] += change;
+    while( !this->molecule_size_count.empty() && this->molecule_size_count.back() == 0 )
+        this->molecule_size_count.pop_back();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::joinMolecules( AtomIndex a, AtomIndex b ) {
+    // (for the methods whose groups aren't molecules) as joinRigidClusters but for bonds of any range
+    AtomIndex ma = this->atom_molecule[ a ];
+    AtomIndex mb = this->atom_molecule[ b ];
+    if( ma != NO_CLUSTER && ma == mb )
+        return; // already connected
+    size_t size_a = ma == NO_CLUSTER ? 1 : this->molecules[ ma ].atoms.size();
+    size_t size_b = mb == NO_CLUSTER ? 1 : this->molecules[ mb ].atoms.size();
+    countMolecule( size_a, -1 );
+    countMolecule( size_b, -1 );
+    countMolecule( size_a + size_b, +1 );
+    if( ma == NO_CLUSTER && mb == NO_CLUSTER ) {
+        vector<AtomIndex> atoms( 1, a );
+        atoms.push_back( b );
+        addMolecule( atoms );
+        return;
+    }
+    // move the members of the smaller molecule into the larger one
+    if( size_a < size_b ) {
+        swap( a, b );
+        swap( ma, mb );
+    }
+    vector<AtomIndex>& members = this->molecules[ ma ].atoms;
+    if( mb == NO_CLUSTER ) {
+        members.push_back( b );
+        this->atom_molecule[ b ] = ma;
+        return;
+    }
+    for( const AtomIndex& iAtom : this->molecules[ mb ].atoms ) {
+        members.push_back( iAtom );
+        this->atom_molecule[ iAtom ] = ma;
+    }
+    this->molecules[ mb ].atoms.clear();
+    this->free_molecules.push_back( mb );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::splitMoleculeIfDisconnected( AtomIndex a, AtomIndex b ) {
+    // (for the methods whose groups aren't molecules) after a bond between a and b has been broken
+    const AtomIndex m = this->atom_molecule[ a ];
+    if( this->is_reached.size() < getNumberOfAtoms() )
+        this->is_reached.resize( getNumberOfAtoms(), 0 );
+    // follow the bonds from a, as far as b if they are still connected
+    vector<AtomIndex> part_a( 1, a );
+    this->is_reached[ a ] = 1;
+    for( size_t i = 0; i < part_a.size() && !this->is_reached[ b ]; ++i ) {
+        for( const Bond& bond : getBonds( part_a[ i ] ) ) {
+            if( this->is_reached[ bond.iAtom ] )
+                continue;
+            this->is_reached[ bond.iAtom ] = 1;
+            part_a.push_back( bond.iAtom );
+        }
+    }
+    const bool still_connected = this->is_reached[ b ];
+    vector<AtomIndex> part_b;
+    if( !still_connected ) {
+        for( const AtomIndex& iAtom : this->molecules[ m ].atoms ) {
+            if( !this->is_reached[ iAtom ] )
+                part_b.push_back( iAtom );
+        }
+    }
+    for( const AtomIndex& iAtom : part_a )
+        this->is_reached[ iAtom ] = 0;
+    if( still_connected )
+        return;
+    // the molecule falls into two, each becoming a new molecule unless it is a lone atom
+    countMolecule( this->molecules[ m ].atoms.size(), -1 );
+    countMolecule( part_a.size(), +1 );
+    countMolecule( part_b.size(), +1 );
+    this->molecules[ m ].atoms.clear();
+    this->free_molecules.push_back( m );
+    addMolecule( part_a );
+    addMolecule( part_b );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::addMolecule( vector<AtomIndex>& atoms ) {
+    // (taking the atoms from the vector given)
+    if( atoms.size() == 1 ) {
+        this->atom_molecule[ atoms.front() ] = NO_CLUSTER;
+        return;
+    }
+    AtomIndex m;
+    if( !this->free_molecules.empty() ) {
+        m = this->free_molecules.back();
+        this->free_molecules.pop_back();
+    }
+    else {
+        m = AtomIndex( this->molecules.size() );
+        this->molecules.push_back( Group() );
+    }
+    for( const AtomIndex& iAtom : atoms )
+        this->atom_molecule[ iAtom ] = m;
+    this->molecules[ m ].atoms.swap( atoms );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::addBondTo( AtomIndex a, AtomIndex b, Neighborhood range ) {
+    const int n = this->num_bonds[ a ];
+    if( n == INLINE_BONDS ) {
+        // the bonds no longer fit with the atom, so move them to an overflow block
+        uint32_t block;
+        if( !this->free_bond_overflow.empty() ) {
+            block = this->free_bond_overflow.back();
+            this->free_bond_overflow.pop_back();
+        }
+        else {
+            block = uint32_t( this->bond_overflow.size() );
+            this->bond_overflow.push_back( OverflowBonds() );
+        }
+        PackedBond* slots = this->bonds.getWritable( a ).slots;
+        copy( slots, slots + n, this->bond_overflow.getWritable( block ).slots );
+        slots[ 0 ] = block;
+    }
+    this->num_bonds[ a ] = uint8_t( n + 1 );
+    getWritableBonds( a )[ n ] = packBond( b, range );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+ArenaBase::PackedBond* ArenaT<Geometry>::getWritableBonds( AtomIndex i ) {
+    PackedBond* slots = this->bonds.getWritable( i ).slots;
+    if( this->num_bonds[ i ] > INLINE_BONDS )
+        return this->bond_overflow.getWritable( slots[ 0 ] ).slots;
+    return slots;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+ArenaBase::Atom ArenaT<Geometry>::getAtom( size_t i ) const {
+    Atom a;
+    a.x = this->atom_x[ i ];
+    a.y = this->atom_y[ i ];
+    a.type = this->atom_type[ i ];
+    for( const Bond& bond : getBonds( AtomIndex( i ) ) )
+        a.bonds.push_back( bond );
+    return a;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+size_t ArenaT<Geometry>::getAtomAt( int x, int y ) const {
+    if( !hasAtom( x, y ) )
+        throw invalid_argument("No atom at that position");
+    return this->cell_atom[ getCell( x, y ) ];
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::getDisplacement( size_t i, int& dx, int& dy ) const {
+    // the grid has walls rather than wrapping around, so the displacement is just the difference
+    dx = this->atom_x[ i ] - this->origin_x[ i ];
+    dy = this->atom_y[ i ] - this->origin_y[ i ];
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+double ArenaT<Geometry>::getMeanSquaredDisplacement() const {
+    // (the sum is kept up to date as atoms move, see displaceAtom)
+    return getNumberOfLiveAtoms() ? double( this->squared_displacement_sum ) / getNumberOfLiveAtoms() : 0.0;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::resetDisplacements() {
+    // (element by element, so that the origins never share chunks with the positions, and only writing
+    // those that differ, so that a fork only copies the chunks of the origins where atoms have moved)
+    for( size_t iAtom = 0; iAtom < getNumberOfAtoms(); ++iAtom ) {
+        if( this->origin_x.get( iAtom ) != this->atom_x.get( iAtom ) )
+            this->origin_x[ iAtom ] = this->atom_x.get( iAtom );
+        if( this->origin_y.get( iAtom ) != this->atom_y.get( iAtom ) )
+            this->origin_y[ iAtom ] = this->atom_y.get( iAtom );
+    }
+    this->squared_displacement_sum = 0;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+vector<size_t> ArenaT<Geometry>::getClusterSizeCounts() const {
+    // (kept up to date as bonds are made and broken, from the groups if they are the molecules, else from
+    // the molecules tracked alongside them)
+    return this->molecule_size_count;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::setMovableRows( int first, int end ) {
+    if( first < 0 || end > getArenaHeight() || first > end )
+        throw out_of_range("Invalid range of rows");
+    this->movable_first_row = first;
+    this->movable_end_row = end;
+    this->kinetic_moves_valid = false;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::setBorrowable( size_t i, bool borrowable ) {
+    if( i >= getNumberOfAtoms() || !isLiveAtom( i ) )
+        throw out_of_range("Invalid atom index");
+    if( this->borrowable[ i ] == uint8_t( borrowable ) )
+        return;
+    this->borrowable[ i ] = uint8_t( borrowable );
+    if( this->kinetic_moves_valid && hasSingleGroups() && this->atom_group[ i ] != NO_GROUP ) {
+        // every mover containing the atom might have changed
+        this->affected_movers.clear();
+        addAffectedMovers( AtomIndex( i ), 0xF, this->affected_movers );
+        recheckMovers( this->affected_movers );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+ArenaBase::AtomHandle ArenaT<Geometry>::getHandle( size_t i ) const {
+    if( i >= getNumberOfAtoms() || !isLiveAtom( i ) )
+        throw out_of_range("Invalid atom index");
+    AtomHandle h = { AtomIndex( i ), this->atom_generation[ i ] };
+    return h;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::isValid( const AtomHandle& a ) const {
+    return a.iAtom < getNumberOfAtoms() && a.generation != 0 && this->atom_generation[ a.iAtom ] == a.generation;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+unsigned int ArenaT<Geometry>::getNewGeneration() {
+    // zero is reserved for removed atoms
+    if( this->next_generation == 0 )
+        this->next_generation = 1;
+    return this->next_generation++;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::displaceAtom( AtomIndex iAtom, int dx, int dy ) {
+    // moves the atom's coordinates, keeping squared_displacement_sum up to date
+    const int ox = this->atom_x.get( iAtom ) - this->origin_x.get( iAtom );
+    const int oy = this->atom_y.get( iAtom ) - this->origin_y.get( iAtom );
+    this->squared_displacement_sum += dx * ( 2 * ox + dx ) + dy * ( 2 * oy + dy );
+    this->atom_x[ iAtom ] += dx;
+    this->atom_y[ iAtom ] += dy;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::removeAtom( const AtomHandle& a ) {
+    if( !isValid( a ) )
+        throw invalid_argument("Invalid atom handle");
+    const AtomIndex iAtom = a.iAtom;
+
+    // breaking the bonds one at a time keeps the groups consistent
+    while( this->num_bonds[ iAtom ] > 0 )
+        breakBondBetween( iAtom, getBonds( iAtom )[ this->num_bonds[ iAtom ] - 1 ].iAtom );
+    if( hasSingleGroups() )
+        removeGroupOf( iAtom ); // (now just this atom, if any)
+    else
+        removeGroupsContaining( iAtom );
+    countMolecule( 1, -1 );
+    int dx, dy;
+    getDisplacement( iAtom, dx, dy );
+    this->squared_displacement_sum -= dx * dx + dy * dy;
+
+    this->occupied[ getCell( this->atom_x[ iAtom ], this->atom_y[ iAtom ] ) ] = false;
+    this->atom_generation[ iAtom ] = 0;
+    this->free_atoms.push_back( iAtom );
+    if( this->kinetic_moves_valid )
+        updateKineticMovesAround( this->atom_x[ iAtom ], this->atom_y[ iAtom ] );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::breakBond( const AtomHandle& a, const AtomHandle& b ) {
+    if( !isValid( a ) || !isValid( b ) )
+        throw invalid_argument("Invalid atom handle");
+    if( !hasBond( a.iAtom, b.iAtom ) )
+        throw invalid_argument("Atoms are not bonded");
+
+    breakBondBetween( a.iAtom, b.iAtom );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::breakBondBetween( AtomIndex a, AtomIndex b ) {
+    const Neighborhood range = removeBondTo( a, b );
+    removeBondTo( b, a );
+    this->bond_range_count[ range ]--;
+    if( range == Neighborhood::vonNeumann )
+        splitRigidCluster( this->rigid_cluster[ a ] );
+    if( !hasMolecules() )
+        splitMoleculeIfDisconnected( a, b );
+
+    switch( this->movement_method ) {
+        case JustAtoms:
+            // atoms without von Neumann bonds can move individually again
+            if( range == Neighborhood::vonNeumann ) {
+                addSingletonGroupIfMobile( a );
+                addSingletonGroupIfMobile( b );
+            }
+            break;
+        case AllGroups:
+            // groups that relied on this bond are no longer connected subgraphs, and a rigid bond
+            // may have pruned groups that can now exist, so start again for the molecules involved
+            regenerateAllGroupsAround( a, b );
+            break;
+        case MPEGSpace:
+            // we don't use groups for this method
+            break;
+        case MPEGMolecules:
+        case MPEGSections:
+        case KineticSections:
+            // the molecule might have fallen into two (its kinetic moves, if any, are brought up to date)
+            splitGroupIfDisconnected( a, b );
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::regenerateAllGroupsAround( AtomIndex a, AtomIndex b ) {
+    // (for AllGroups) replace the groups of the molecules containing a and b by starting from lone atoms
+    // and adding their bonds back one at a time, as makeBond would have done
+    vector<AtomIndex> members;
+    vector<bool> visited( getNumberOfAtoms(), false );
+    const AtomIndex starts[2] = { a, b };
+    for( const AtomIndex& start : starts ) {
+        if( visited[ start ] )
+            continue;
+        visited[ start ] = true;
+        const size_t first = members.size();
+        members.push_back( start );
+        for( size_t i = first; i < members.size(); ++i ) {
+            for( const Bond& bond : getBonds( members[ i ] ) ) {
+                if( visited[ bond.iAtom ] )
+                    continue;
+                visited[ bond.iAtom ] = true;
+                members.push_back( bond.iAtom );
+            }
+        }
+    }
+    sort( begin( members ), end( members ) );
+
+    // every group lies within one molecule, so checking one atom is enough
+    class GroupIsAmong {
+        public:
+            GroupIsAmong( const vector<AtomIndex>& atoms ) : atoms(atoms) {}
+            bool operator() (const Group& g) const { return binary_search( begin(atoms), end(atoms), g.atoms.front() ); }
+        private:
+            const vector<AtomIndex>& atoms;
+    };
+
+    vector<Group>& groups = getWritableGroups();
+    groups.erase( remove_if( begin( groups ), end( groups ),
+        GroupIsAmong( members ) ), end( groups ) );
+    for( const AtomIndex& iAtom : members ) {
+        Group group;
+        group.atoms.push_back( iAtom );
+        getWritableGroups().push_back( group );
+    }
+    for( const AtomIndex& iAtom : members ) {
+        for( const Bond& bond : getBonds( iAtom ) ) {
+            if( bond.iAtom < iAtom )
+                continue; // (each bond once)
+            addAllGroupsForNewBond( iAtom, bond.iAtom );
+            if( bond.range == Neighborhood::vonNeumann )
+                removeGroupsWithOneButNotTheOther( iAtom, bond.iAtom );
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+ArenaBase::Neighborhood ArenaT<Geometry>::removeBondTo( AtomIndex a, AtomIndex b ) {
+    // the last bond fills the gap, since the order doesn't matter
+    const int n = this->num_bonds[ a ];
+    PackedBond* first = getWritableBonds( a );
+    PackedBond* bond = first;
+    while( unpackBond( *bond ).iAtom != b )
+        bond++;
+    const Neighborhood range = unpackBond( *bond ).range;
+    *bond = first[ n - 1 ];
+    if( n - 1 == INLINE_BONDS ) {
+        // they fit with the atom again
+        const uint32_t block = this->bonds.get( a ).slots[ 0 ];
+        copy( first, first + INLINE_BONDS, this->bonds.getWritable( a ).slots );
+        this->free_bond_overflow.push_back( block );
+    }
+    this->num_bonds[ a ] = uint8_t( n - 1 );
+    return range;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::addSingletonGroupIfMobile( AtomIndex a ) {
+    for( const Bond& bond : getBonds( a ) ) {
+        if( bond.range == Neighborhood::vonNeumann )
+            return; // still rigidly bonded
+    }
+    if( this->atom_group[ a ] != NO_GROUP )
+        return; // already present
+    Group group;
+    group.atoms.push_back( a );
+    getWritableGroups().push_back( group );
+    this->atom_group[ a ] = AtomIndex( getGroups().size() - 1 );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::removeGroupsContaining( AtomIndex a ) {
+
+    class GroupContains {
+        public:
+            GroupContains( AtomIndex a ) : a(a) {}
+            bool operator() (const Group& g) const { return binary_search( begin(g.atoms), end(g.atoms), a ); }
+        private:
+            AtomIndex a;
+    };
+
+    vector<Group>& groups = getWritableGroups();
+    groups.erase( remove_if( begin( groups ), end( groups ),
+        GroupContains( a ) ), end( groups ) );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+size_t ArenaT<Geometry>::floodFillGroup( const Group& group, size_t iStartMember, vector<bool>& reached ) const {
+    // follow the bonds between members of the group, returning how many members were reached
+    reached.assign( group.atoms.size(), false );
+    reached[ iStartMember ] = true;
+    size_t num_reached = 1;
+    vector<size_t> to_visit( 1, iStartMember );
+    while( !to_visit.empty() ) {
+        const size_t iMember = to_visit.back();
+        to_visit.pop_back();
+        for( const Bond& bond : getBonds( group.atoms[ iMember ] ) ) {
+            const auto& it = lower_bound( begin( group.atoms ), end( group.atoms ), bond.iAtom );
+            if( it == end( group.atoms ) || *it != bond.iAtom )
+                continue; // not a member
+            const size_t iMember2 = it - begin( group.atoms );
+            if( reached[ iMember2 ] )
+                continue;
+            reached[ iMember2 ] = true;
+            num_reached++;
+            to_visit.push_back( iMember2 );
+        }
+    }
+    return num_reached;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::splitGroupIfDisconnected( AtomIndex a, AtomIndex b ) {
+    const size_t iGroup = this->atom_group[ a ];
+    if( this->kinetic_moves_valid )
+        removeKineticMoves( iGroup );
+    Group& g = getWritableGroups()[ iGroup ];
+    TRACE_SCOPE_VALUE("splitGroupIfDisconnected", g.atoms.size());
+    g.has_sections = false; // the molecule's bond graph has changed
+    vector<bool> reached;
+    floodFillGroup( g, lower_bound( begin( g.atoms ), end( g.atoms ), a ) - begin( g.atoms ), reached );
+    if( reached[ lower_bound( begin( g.atoms ), end( g.atoms ), b ) - begin( g.atoms ) ] ) {
+        // still connected
+        if( this->kinetic_moves_valid )
+            addKineticMoves( iGroup );
+        return;
+    }
+    // the part no longer attached to a becomes a new group
+    Group part_a, part_b;
+    for( size_t iMember = 0; iMember < g.atoms.size(); ++iMember )
+        ( reached[ iMember ] ? part_a : part_b ).atoms.push_back( g.atoms[ iMember ] );
+    countMolecule( g.atoms.size(), -1 );
+    countMolecule( part_a.atoms.size(), +1 );
+    countMolecule( part_b.atoms.size(), +1 );
+    g.atoms.swap( part_a.atoms );
+    const size_t iNewGroup = getGroups().size();
+    for( const AtomIndex& iAtom : part_b.atoms )
+        this->atom_group[ iAtom ] = AtomIndex( iNewGroup );
+    getWritableGroups().push_back( part_b );
+    if( this->kinetic_moves_valid ) {
+        this->kinetic_groups.push_back( KineticGroup() );
+        addKineticMoves( iGroup );
+        addKineticMoves( iNewGroup );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::removeGroupOf( AtomIndex a ) {
+    // (for a group of just this atom, see hasSingleGroups)
+    const AtomIndex iGroup = this->atom_group[ a ];
+    if( iGroup == NO_GROUP )
+        return;
+    removeGroup( iGroup );
+    this->atom_group[ a ] = NO_GROUP;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::removeGroup( size_t iGroup ) {
+    // the last group fills the gap, since the order doesn't matter
+    vector<Group>& groups = getWritableGroups();
+    if( this->kinetic_moves_valid )
+        removeKineticMoves( iGroup );
+    const size_t iLast = groups.size() - 1;
+    if( iGroup != iLast ) {
+        groups[ iGroup ] = std::move( groups[ iLast ] );
+        for( const AtomIndex& iAtom : groups[ iGroup ].atoms )
+            this->atom_group[ iAtom ] = AtomIndex( iGroup );
+        if( this->kinetic_moves_valid ) {
+            this->kinetic_groups[ iGroup ] = std::move( this->kinetic_groups[ iLast ] );
+            for( const uint32_t& position : this->kinetic_groups[ iGroup ].feasible_position ) {
+                if( position != NOT_FEASIBLE )
+                    this->feasible_moves[ position ].iGroup = uint32_t( iGroup );
+            }
+        }
+    }
+    groups.pop_back();
+    if( this->kinetic_moves_valid )
+        this->kinetic_groups.pop_back();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::joinRigidClusters( AtomIndex a, AtomIndex b ) {
+    AtomIndex ca = this->rigid_cluster[ a ];
+    AtomIndex cb = this->rigid_cluster[ b ];
+    if( ca == NO_CLUSTER && cb == NO_CLUSTER ) {
+        // a new cluster of two
+        AtomIndex c;
+        if( !this->free_rigid_clusters.empty() ) {
+            c = this->free_rigid_clusters.back();
+            this->free_rigid_clusters.pop_back();
+        }
+        else {
+            c = AtomIndex( this->rigid_clusters.size() );
+            this->rigid_clusters.push_back( Group() );
+        }
+        this->rigid_clusters[ c ].atoms.push_back( a );
+        this->rigid_clusters[ c ].atoms.push_back( b );
+        this->rigid_cluster[ a ] = this->rigid_cluster[ b ] = c;
+        return;
+    }
+    if( ca == cb )
+        return; // already rigidly connected
+    // move the members of the smaller cluster into the larger one
+    if( ca == NO_CLUSTER || ( cb != NO_CLUSTER && this->rigid_clusters[ ca ].atoms.size() < this->rigid_clusters[ cb ].atoms.size() ) ) {
+        swap( a, b );
+        swap( ca, cb );
+    }
+    vector<AtomIndex>& members = this->rigid_clusters[ ca ].atoms;
+    if( cb == NO_CLUSTER ) {
+        members.push_back( b );
+        this->rigid_cluster[ b ] = ca;
+        return;
+    }
+    for( const AtomIndex& iAtom : this->rigid_clusters[ cb ].atoms ) {
+        members.push_back( iAtom );
+        this->rigid_cluster[ iAtom ] = ca;
+    }
+    this->rigid_clusters[ cb ].atoms.clear();
+    this->free_rigid_clusters.push_back( cb );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::splitRigidCluster( AtomIndex c ) {
+    // dissolve the cluster then rebuild it from the von Neumann bonds between its old members
+    vector<AtomIndex> members;
+    members.swap( this->rigid_clusters[ c ].atoms );
+    this->free_rigid_clusters.push_back( c );
+    for( const AtomIndex& iAtom : members )
+        this->rigid_cluster[ iAtom ] = NO_CLUSTER;
+    for( const AtomIndex& iAtom : members ) {
+        for( const Bond& bond : getBonds( iAtom ) ) {
+            if( bond.range == Neighborhood::vonNeumann )
+                joinRigidClusters( iAtom, bond.iAtom );
+        }
+    }
 }
 
 //----------------------------------------------------------------------------
 
-bool Arena::isOffGrid( int x, int y ) const {
-    return x < 0 || x >= X || y < 0 || y >= Y;
+template<class Geometry>
+void ArenaT<Geometry>::compact() {
+    TRACE_SCOPE("compact");
+    vector<AtomIndex> new_index( getNumberOfAtoms() );
+    AtomIndex num_atoms = 0;
+    for( size_t iAtom = 0; iAtom < getNumberOfAtoms(); ++iAtom ) {
+        if( isLiveAtom( iAtom ) )
+            new_index[ iAtom ] = num_atoms++;
+    }
+    renumberAtoms( new_index, num_atoms );
 }
 
 //----------------------------------------------------------------------------
 
-bool Arena::hasAtom( int x, int y ) const {
-    if( isOffGrid(x,y ) )
-		throw out_of_range("Atom not on grid");
-
-    return this->grid[x][y].has_atom;
+template<class Geometry>
+void ArenaT<Geometry>::sortAtomsSpatially() {
+    TRACE_SCOPE("sortAtomsSpatially");
+    // atoms that are close on the grid are close along the curve, so bond and grid lookups stay in cache
+    vector<pair<uint64_t,AtomIndex>> keys;
+    keys.reserve( getNumberOfLiveAtoms() );
+    for( size_t iAtom = 0; iAtom < getNumberOfAtoms(); ++iAtom ) {
+        if( isLiveAtom( iAtom ) )
+            keys.push_back( make_pair( getMortonKey( this->atom_x[ iAtom ], this->atom_y[ iAtom ] ), AtomIndex( iAtom ) ) );
+    }
+    sort( begin( keys ), end( keys ) );
+    vector<AtomIndex> new_index( getNumberOfAtoms() );
+    for( size_t i = 0; i < keys.size(); ++i )
+        new_index[ keys[ i ].second ] = AtomIndex( i );
+    renumberAtoms( new_index, keys.size() );
 }
-    
-//----------------------------------------------------------------------------
 
-size_t Arena::addAtom( int x, int y, int type ) {
-
-    if( isOffGrid(x,y ) )
-		throw out_of_range("Atom not on grid");
-
-	Slot& slot = this->grid[x][y];
-	if( slot.has_atom )
-		throw exception("Grid already contains an atom at that position");
-
-	Atom a;
-	a.x = x;
-	a.y = y;
-    a.type = type;
-	this->atoms.push_back( a );
-	size_t iAtom = this->atoms.size()-1;
-
-    slot.has_atom = true;
-    slot.iAtom = iAtom;
-
-	Group group;
-	group.atoms.push_back( iAtom );
-	this->groups.push_back( group );
+//----------------------------------------------------------------------------
 
-	return iAtom;
+uint64_t ArenaBase::getMortonKey( int x, int y ) {
+    // interleave the bits of x and y
+    uint64_t key = 0;
+    for( int iBit = 0; iBit < 32; ++iBit ) {
+        key |= uint64_t( ( x >> iBit ) & 1 ) << ( 2 * iBit );
+        key |= uint64_t( ( y >> iBit ) & 1 ) << ( 2 * iBit + 1 );
+    }
+    return key;
 }
 
 //----------------------------------------------------------------------------
 
-void Arena::makeBond( size_t a, size_t b, Neighborhood range ) {
-	if( a < 0 || a >= atoms.size() || b < 0 || b >= atoms.size() )
-		throw out_of_range("Invalid atom index");
-	if( a == b )
-		throw invalid_argument("Cannot bond atom to itself");
-    if( !isWithinNeighborhood( range, this->atoms[a].x, this->atoms[a].y, this->atoms[b].x, this->atoms[b].y ) )
-        throw invalid_argument("Atoms are too far apart to be bonded");
-    if( hasBond( a, b ) )
-        throw invalid_argument("Atoms are already bonded");
-
-    Bond ab = { b, range };
-    this->atoms[ a ].bonds.push_back( ab );
-    Bond ba = { a, range };
-    this->atoms[ b ].bonds.push_back( ba );
-
-    switch( this->movement_method ) {
-        case JustAtoms:
-            // here we can never move atoms with von Neumann bonds so
-            // we can remove any groups with them in
-            if( range == Neighborhood::vonNeumann )
-                removeGroupsWithOneButNotTheOther( a, b );
-            break;
-        case AllGroups:
-            //  we need to find all the subgraphs created by this new bond
-	        addAllGroupsForNewBond( a, b );
-            // if a and b are rigidly bonded then we don't need to check their groups separately
-            if( range == Neighborhood::vonNeumann )
-                removeGroupsWithOneButNotTheOther( a, b );
-            break;
-        case MPEGSpace: 
-            // we don't use groups for this method
-            break;
-        case MPEGMolecules: 
-            // here each molecule is a single group
-            combineGroupsInvolvingTheseIntoOne( a, b );
-            break;
+template<class Geometry>
+void ArenaT<Geometry>::renumberAtoms( const vector<AtomIndex>& new_index, size_t num_atoms ) {
+    // new_index maps every live atom to its new position, and is ignored for removed ones
+    ArenaVector<Coordinate> new_x( num_atoms ), new_y( num_atoms ), new_origin_x( num_atoms ), new_origin_y( num_atoms );
+    ArenaVector<uint8_t> new_type( num_atoms ), new_num_bonds( num_atoms ), new_borrowable( num_atoms );
+    ArenaVector<BondSlots,10> new_bonds( num_atoms );
+    ArenaVector<AtomIndex> new_rigid_cluster( num_atoms ), new_atom_group( num_atoms ), new_atom_molecule( num_atoms );
+    for( size_t iAtom = 0; iAtom < getNumberOfAtoms(); ++iAtom ) {
+        if( !isLiveAtom( iAtom ) )
+            continue;
+        const AtomIndex i = new_index[ iAtom ];
+        new_x[ i ] = this->atom_x[ iAtom ];
+        new_y[ i ] = this->atom_y[ iAtom ];
+        new_origin_x[ i ] = this->origin_x[ iAtom ];
+        new_origin_y[ i ] = this->origin_y[ iAtom ];
+        new_type[ i ] = this->atom_type[ iAtom ];
+        new_num_bonds[ i ] = this->num_bonds[ iAtom ];
+        new_borrowable[ i ] = this->borrowable[ iAtom ];
+        new_rigid_cluster[ i ] = this->rigid_cluster[ iAtom ];
+        new_atom_group[ i ] = this->atom_group[ iAtom ];
+        new_atom_molecule[ i ] = this->atom_molecule[ iAtom ];
+        // (an overflow block stays where it is, with its bonds renumbered in place)
+        PackedBond* new_bond;
+        if( this->num_bonds[ iAtom ] > INLINE_BONDS ) {
+            new_bonds.getWritable( i ).slots[ 0 ] = this->bonds.get( iAtom ).slots[ 0 ];
+            new_bond = getWritableBonds( AtomIndex( iAtom ) );
+        }
+        else
+            new_bond = new_bonds.getWritable( i ).slots;
+        for( const Bond& bond : getBonds( AtomIndex( iAtom ) ) )
+            *new_bond++ = packBond( new_index[ bond.iAtom ], bond.range );
+        this->cell_atom[ getCell( new_x[ i ], new_y[ i ] ) ] = i;
     }
+    for( Group& g : getWritableGroups() ) {
+        for( AtomIndex& iAtom : g.atoms )
+            iAtom = new_index[ iAtom ];
+        sort( begin( g.atoms ), end( g.atoms ) );
+        g.has_sections = false;
+    }
+    for( Group& g : this->rigid_clusters ) {
+        for( AtomIndex& iAtom : g.atoms )
+            iAtom = new_index[ iAtom ];
+    }
+    for( Group& g : this->molecules ) {
+        for( AtomIndex& iAtom : g.atoms )
+            iAtom = new_index[ iAtom ];
+    }
+    this->atom_x.swap( new_x );
+    this->atom_y.swap( new_y );
+    this->origin_x.swap( new_origin_x );
+    this->origin_y.swap( new_origin_y );
+    this->atom_type.swap( new_type );
+    this->num_bonds.swap( new_num_bonds );
+    this->borrowable.swap( new_borrowable );
+    this->bonds.swap( new_bonds );
+    this->rigid_cluster.swap( new_rigid_cluster );
+    this->atom_group.swap( new_atom_group );
+    this->atom_molecule.swap( new_atom_molecule );
+    // every outstanding handle is now stale
+    this->atom_generation.assign( num_atoms, getNewGeneration() );
+    this->free_atoms.clear();
+    this->kinetic_moves_valid = false;
 }
 
 //----------------------------------------------------------------------------
 
-void Arena::addAllGroupsForNewBond( size_t a, size_t b ) {
+template<class Geometry>
+void ArenaT<Geometry>::addAllGroupsForNewBond( AtomIndex a, AtomIndex b ) {
 	// add new groups obtained by combining pairwise every group that includes a but not b 
     // with every group that includes b but not a
 	vector<Group> new_groups;
-	for( const auto& ga : this->groups ) {
+	for( const auto& ga : getGroups() ) {
 		if( find( begin( ga.atoms ), end( ga.atoms ), a ) == end( ga.atoms ) )
 			continue;
 		if( find( begin( ga.atoms ), end( ga.atoms ), b ) != end( ga.atoms ) )
 			continue;
         // (ga contains a but not b)
-		for( const auto& gb : this->groups ) {
+		for( const auto& gb : getGroups() ) {
 			if( find( begin( gb.atoms ), end( gb.atoms ), b ) == end( gb.atoms ) )
 				continue;
 			if( find( begin( gb.atoms ), end( gb.atoms ), a ) != end( gb.atoms ) )
@@ -130,7 +1163,7 @@ void Arena::addAllGroupsForNewBond( size_t a, size_t b ) {
             new_group.atoms.resize( end - new_group.atoms.begin() );
             // add to the list if unique
             bool is_unique = true;
-            for( const auto& g2 : this->groups ) {
+            for( const auto& g2 : getGroups() ) {
                 if( g2.atoms == new_group.atoms ) {
                     is_unique = false;
                     break;
@@ -140,16 +1173,17 @@ void Arena::addAllGroupsForNewBond( size_t a, size_t b ) {
                 new_groups.push_back( new_group );
         }
     }
-	this->groups.insert( this->groups.end(), new_groups.begin(), new_groups.end() );
+	getWritableGroups().insert( getWritableGroups().end(), new_groups.begin(), new_groups.end() );
 }
 
 //----------------------------------------------------------------------------
 
-void Arena::removeGroupsWithOneButNotTheOther( size_t a, size_t b ) {
+template<class Geometry>
+void ArenaT<Geometry>::removeGroupsWithOneButNotTheOther( AtomIndex a, AtomIndex b ) {
 
     class GroupHasOneButNotTheOther {
         public:
-            GroupHasOneButNotTheOther( size_t a, size_t b ) : a(a), b(b) {}
+            GroupHasOneButNotTheOther( AtomIndex a, AtomIndex b ) : a(a), b(b) {}
             bool operator() (const Group& g) const
             { 
                 int n = 0;
@@ -158,16 +1192,17 @@ void Arena::removeGroupsWithOneButNotTheOther( size_t a, size_t b ) {
                 return n == 1;
             }
         private:
-            size_t a,b;
+            AtomIndex a,b;
     };
 
-    this->groups.erase( remove_if( begin( this->groups ), end( this->groups ), 
-        GroupHasOneButNotTheOther( a, b ) ), end( this->groups ) );
+    vector<Group>& groups = getWritableGroups();
+    groups.erase( remove_if( begin( groups ), end( groups ), 
+        GroupHasOneButNotTheOther( a, b ) ), end( groups ) );
 }
 
 //----------------------------------------------------------------------------
 
-bool Arena::isWithinNeighborhood( Neighborhood type, int x1, int y1, int x2, int y2 ) {
+bool ArenaBase::isWithinNeighborhood( Neighborhood type, int x1, int y1, int x2, int y2 ) {
     const int r2 = (x1-x2)*(x1-x2) + (y1-y2)*(y1-y2);
     switch( type ) {
         case vonNeumann:  return r2 <= 1;
@@ -181,7 +1216,30 @@ bool Arena::isWithinNeighborhood( Neighborhood type, int x1, int y1, int x2, int
 
 //----------------------------------------------------------------------------
 
-void Arena::getRandomMove( Neighborhood nhood, int &dx, int &dy ) {
+ArenaBase::Neighborhood ArenaBase::getNeighborhood( const string& name ) {
+    for( int range = vonNeumann; range <= Moore2; ++range ) {
+        if( name == getNeighborhoodName( Neighborhood( range ) ) )
+            return Neighborhood( range );
+    }
+    throw runtime_error("Unknown bond range: " + name);
+}
+
+//----------------------------------------------------------------------------
+
+const char* ArenaBase::getNeighborhoodName( Neighborhood range ) {
+    switch( range ) {
+        case vonNeumann:  return "vonNeumann";
+        case Moore:       return "Moore";
+        case vonNeumann2: return "vonNeumann2";
+        case knight:      return "knight";
+        case Moore2:      return "Moore2";
+    }
+    throw out_of_range("unexpected enum");
+}
+
+//----------------------------------------------------------------------------
+
+void ArenaBase::getRandomMove( Neighborhood nhood, int &dx, int &dy ) {
     switch( nhood ) {
         case Neighborhood::vonNeumann: {
             const int vNx[4] = {  0,  1,  0, -1 }; // clockwise from North
@@ -205,12 +1263,31 @@ void Arena::getRandomMove( Neighborhood nhood, int &dx, int &dy ) {
 
 //----------------------------------------------------------------------------
 
-void Arena::update() {
+template<class Geometry>
+void ArenaT<Geometry>::update() {
+    TRACE_SCOPE("update");
+    // restore memory locality every so often, if asked to (this renumbers the atoms, see setSpatialSortInterval)
+    this->num_updates++;
+    if( this->spatial_sort_interval > 0 && this->num_updates % this->spatial_sort_interval == 0 )
+        sortAtomsSpatially();
+
+    // let everything have a go at moving
+    moveEverything();
+
+    // find chemical reactions
+    doChemistry();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::moveEverything() {
+    TRACE_SCOPE("moveEverything");
     switch( this->movement_method ) {
         case JustAtoms:
         case AllGroups:
             // attempt to move every group
-            for( const auto& group : this->groups ) {
+            for( const auto& group : getGroups() ) {
                 int dx, dy;
                 getRandomMove( this->movement_neighborhood, dx, dy );
                 moveGroupIfPossible( group, dx, dy );
@@ -219,10 +1296,10 @@ void Arena::update() {
         case MPEGSpace: {
             for( int i = 0; i < 10; ++i ) {
                 // attempt to move a block
-                int x = getRandIntInclusive( 0, this->X-1 );
-                int y = getRandIntInclusive( 0, this->Y-1 );
-                int w = getRandIntInclusive( 1, this->X-x );
-                int h = getRandIntInclusive( 1, this->Y-y );
+                int x = getRandIntInclusive( 0, getArenaWidth()-1 );
+                int y = getRandIntInclusive( 0, getArenaHeight()-1 );
+                int w = getRandIntInclusive( 1, getArenaWidth()-x );
+                int h = getRandIntInclusive( 1, getArenaHeight()-y );
                 int dx, dy;
                 getRandomMove( this->movement_neighborhood, dx, dy );
                 moveBlockIfPossible( x, y, w, h, dx, dy );
@@ -231,34 +1308,110 @@ void Arena::update() {
         }
         case MPEGMolecules:
             // attempt to move every group
-            for( const auto& group : this->groups ) {
+            for( const auto& group : getGroups() ) {
                 moveBlocksInGroup( group );
             }
             break;
+        case MPEGSections:
+            // attempt to move every group and its sections
+            for( size_t iGroup = 0; iGroup < getGroups().size(); ++iGroup ) {
+                moveSectionsOfGroup( iGroup );
+            }
+            break;
+        case KineticSections:
+            // advance the simulated time by one update
+            moveSectionsKinetically();
+            break;
     }
-
-    // find chemical reactions
-    doChemistry();
 }
 
 //----------------------------------------------------------------------------
 
-void Arena::doChemistry() {
-    for( int x = 0; x < this->X; ++x ) {
-        for( int y = 0; y < this->Y; ++y ) {
-            if( !this->grid[x][y].has_atom ) continue;
+template<class Geometry>
+void ArenaT<Geometry>::doChemistry() {
+    TRACE_SCOPE("doChemistry");
+    const size_t num_states = MAX_BONDS + 1;
+    const size_t num_classes_b = this->num_type_classes + 1;
+    for( int y = 0; y < getArenaHeight(); ++y ) {
+        for( int x = 0; x < getArenaWidth(); ++x ) { // (along the rows, as the grid is stored)
+            if( !this->occupied[ getCell( x, y ) ] ) continue;
             int dx, dy;
             getRandomMove( this->chemical_neighborhood, dx, dy );
             int tx = x + dx;
             int ty = y + dy;
-            if( isOffGrid( tx, ty ) || !this->grid[tx][ty].has_atom ) continue;
-            size_t iAtomA = this->grid[x][y].iAtom;
-            size_t iAtomB = this->grid[tx][ty].iAtom;
-            Atom& a = this->atoms[ iAtomA ];
-            Atom& b = this->atoms[ iAtomB ];
-            if( !hasBond( iAtomA, iAtomB ) && a.type == b.type && a.bonds.size() + b.bonds.size() < 2 ) {
-                Neighborhood bond_range = Neighborhood::Moore;
-                makeBond( iAtomA, iAtomB, bond_range );
+            if( isOffGrid( tx, ty ) || !this->occupied[ getCell( tx, ty ) ] ) continue;
+            AtomIndex iAtomA = this->cell_atom[ getCell( x, y ) ];
+            AtomIndex iAtomB = this->cell_atom[ getCell( tx, ty ) ];
+            if( isFrozen( iAtomA ) && isFrozen( iAtomB ) ) continue;
+            const uint8_t type_a = this->atom_type[ iAtomA ];
+            const uint8_t type_b = this->atom_type[ iAtomB ];
+            size_t class_b = this->type_class[ type_b ];
+            if( class_b == 0 && type_a == type_b )
+                class_b = this->num_type_classes; // (see setChemistry)
+            const Reaction& reaction = this->reactions[ ( ( this->num_bonds[ iAtomA ] * num_states + this->num_bonds[ iAtomB ] )
+                                                          * this->num_type_classes + this->type_class[ type_a ] ) * num_classes_b + class_b ];
+            if( reaction.chance == 0 || ( reaction.chance <= RAND_MAX && uint32_t( rand() ) >= reaction.chance ) )
+                continue;
+            if( !hasBond( iAtomA, iAtomB ) )
+                makeBond( iAtomA, iAtomB, reaction.range );
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::setChemistry( const Chemistry& chemistry ) {
+    // Compile the rules into a dense table over (bondsA, bondsB, classA, classB) so that doChemistry needs only one lookup.
+    // Each type named in a rule gets a class of its own and all the others share class 0. For atom B there is
+    // one more class, for an unnamed type that is the same as A's, so that rules using = can still tell.
+    this->type_class.assign( numeric_limits<uint8_t>::max() + 1, 0 );
+    this->num_type_classes = 1;
+    for( const Chemistry::Rule& rule : chemistry.rules ) {
+        const int types[2] = { rule.type_a, rule.type_b };
+        for( const int& type : types ) {
+            if( type >= 0 && this->type_class[ type ] == 0 )
+                this->type_class[ type ] = uint16_t( this->num_type_classes++ );
+        }
+    }
+    const int num_states = MAX_BONDS + 1;
+    const int num_classes_b = this->num_type_classes + 1;
+    const Reaction no_reaction = { 0, vonNeumann };
+    this->reactions.assign( size_t( num_states ) * num_states * this->num_type_classes * num_classes_b, no_reaction );
+
+    // earlier rules win, so write them last
+    for( size_t iRule = chemistry.rules.size(); iRule-- > 0; ) {
+        const Chemistry::Rule& rule = chemistry.rules[ iRule ];
+        Reaction reaction;
+        reaction.range = rule.range;
+        reaction.chance = rule.probability >= 1.0 ? UINT32_MAX : uint32_t( rule.probability * ( RAND_MAX + 1.0 ) );
+        for( int iWay = 0; iWay < 2; ++iWay ) {
+            // the rule applies both ways around
+            const bool swapped = ( iWay == 1 );
+            if( swapped && rule.type_b == Chemistry::SAME && rule.bonds_a == rule.bonds_b )
+                break; // (symmetric already)
+            const int type_a = swapped && rule.type_b != Chemistry::SAME ? rule.type_b : rule.type_a;
+            const int type_b = swapped && rule.type_b != Chemistry::SAME ? rule.type_a : rule.type_b;
+            const int bonds_a = swapped ? rule.bonds_b : rule.bonds_a;
+            const int bonds_b = swapped ? rule.bonds_a : rule.bonds_b;
+            for( int sa = 0; sa < MAX_BONDS; ++sa ) {
+                if( bonds_a != Chemistry::ANY && bonds_a != sa ) continue;
+                for( int sb = 0; sb < MAX_BONDS; ++sb ) {
+                    if( bonds_b != Chemistry::ANY && bonds_b != sb ) continue;
+                    for( int ca = 0; ca < this->num_type_classes; ++ca ) {
+                        if( type_a != Chemistry::ANY && this->type_class[ type_a ] != ca ) continue;
+                        for( int cb = 0; cb < num_classes_b; ++cb ) {
+                            const bool unnamed_same = ( cb == this->num_type_classes );
+                            if( type_b == Chemistry::SAME ) {
+                                if( !( ca == 0 ? unnamed_same : cb == ca ) ) continue;
+                            }
+                            else if( type_b != Chemistry::ANY ) {
+                                if( unnamed_same || this->type_class[ type_b ] != cb ) continue;
+                            }
+                            this->reactions[ ( size_t( sa * num_states + sb ) * this->num_type_classes + ca ) * num_classes_b + cb ] = reaction;
+                        }
+                    }
+                }
             }
         }
     }
@@ -266,17 +1419,19 @@ void Arena::doChemistry() {
 
 //----------------------------------------------------------------------------
 
-bool Arena::moveGroupIfPossible( const Group& group, int dx, int dy ) {
+template<class Geometry>
+bool ArenaT<Geometry>::moveGroupIfPossible( const Group& group, int dx, int dy ) {
+    if( !isMovableSet( group.atoms ) )
+        return false;
     // first test: would this move stretch any bond too far?
     bool can_move = true;
-    for( const size_t& iAtomIn : group.atoms ) {
-        for( const Bond& bond : this->atoms[ iAtomIn ].bonds ) {
-            const size_t& iAtomOut = bond.iAtom;
+    for( const AtomIndex& iAtomIn : group.atoms ) {
+        for( const Bond& bond : getBonds( iAtomIn ) ) {
+            const AtomIndex& iAtomOut = bond.iAtom;
             bool b_in_group = find( begin( group.atoms ), end( group.atoms ), iAtomOut ) != end( group.atoms );
             if( b_in_group ) continue; 
-            const Atom& atomIn  = this->atoms[ iAtomIn ];
-            const Atom& atomOut = this->atoms[ iAtomOut ];
-            if( !isWithinNeighborhood( bond.range, atomIn.x + dx, atomIn.y + dy, atomOut.x, atomOut.y ) ) {
+            if( !isWithinNeighborhood( bond.range, this->atom_x[ iAtomIn ] + dx, this->atom_y[ iAtomIn ] + dy,
+                                       this->atom_x[ iAtomOut ], this->atom_y[ iAtomOut ] ) ) {
                 can_move = false;
                 break;
             }
@@ -286,15 +1441,13 @@ bool Arena::moveGroupIfPossible( const Group& group, int dx, int dy ) {
     // overlap test. 
     // simple implementation for now: remove from grid and try to place in the new position, else replace
     for( const auto& iAtom : group.atoms ) {
-        const Atom &atom = this->atoms[ iAtom ];
-        this->grid[ atom.x ][ atom.y ].has_atom = false;
+        this->occupied[ getCell( this->atom_x[ iAtom ], this->atom_y[ iAtom ] ) ] = false;
     }
     bool all_ok = true;
     for( const auto& iAtom : group.atoms ) {
-        const Atom &atom = this->atoms[ iAtom ];
-        int tx = atom.x + dx;
-        int ty = atom.y + dy;
-        if( isOffGrid( tx, ty ) || this->grid[ tx ][ ty ].has_atom ) {
+        int tx = this->atom_x[ iAtom ] + dx;
+        int ty = this->atom_y[ iAtom ] + dy;
+        if( isOffGrid( tx, ty ) || this->occupied[ getCell( tx, ty ) ] ) {
             all_ok = false;
             break;
         }
@@ -303,94 +1456,168 @@ bool Arena::moveGroupIfPossible( const Group& group, int dx, int dy ) {
         dx = dy = 0;
     }
     for( const auto& iAtom : group.atoms ) {
-        Atom &atom = this->atoms[ iAtom ];
-        atom.x += dx;
-        atom.y += dy;
-        this->grid[ atom.x ][ atom.y ].has_atom = true;
-        this->grid[ atom.x ][ atom.y ].iAtom = iAtom;
+        displaceAtom( iAtom, dx, dy );
+        const size_t cell = getCell( this->atom_x[ iAtom ], this->atom_y[ iAtom ] );
+        this->occupied[ cell ] = true;
+        this->cell_atom[ cell ] = iAtom;
     }
     return all_ok;
 }
 
 //----------------------------------------------------------------------------
 
-bool Arena::moveBlockIfPossible( int x, int y, int w, int h, int dx, int dy ) {
+template<class Geometry>
+bool ArenaT<Geometry>::moveBlockIfPossible( int x, int y, int w, int h, int dx, int dy ) {
     const int left = x;
     const int right = x + w - 1;
     const int top = y;
     const int bottom = y + h - 1;
     if( isOffGrid( left, top ) || isOffGrid( right, bottom ) )
         throw out_of_range("Attempt to move block that is not wholy on the grid");
+    // frozen test: as in isMovableSet, atoms outside the movable rows must be borrowable, and below an
+    // atom of the block that is in them
+    if( top < this->movable_first_row || bottom >= this->movable_end_row ) {
+        bool has_movable = false;
+        for( int sy = top; sy <= bottom; ++sy ) {
+            const bool movable_row = sy >= this->movable_first_row && sy < this->movable_end_row;
+            if( movable_row && has_movable )
+                continue;
+            for( int sx = left; sx <= right; ++sx ) {
+                if( !this->occupied[ getCell( sx, sy ) ] )
+                    continue;
+                if( movable_row ) {
+                    has_movable = true;
+                    break;
+                }
+                if( !has_movable || !this->borrowable[ this->cell_atom[ getCell( sx, sy ) ] ] )
+                    return false;
+            }
+        }
+    }
+    // rigid test: a block that cuts through a rigid cluster can never move, and this is the cheapest check
+    for( int sy = top; sy <= bottom; ++sy ) {
+        for( int sx = left; sx <= right; ++sx ) {
+            if( sx > left && sx < right && sy > top && sy < bottom )
+                continue; // not on the edge of the block
+            if( !this->occupied[ getCell( sx, sy ) ] || this->rigid_cluster[ this->cell_atom[ getCell( sx, sy ) ] ] == NO_CLUSTER )
+                continue;
+            for( const Bond& bond : getBonds( this->cell_atom[ getCell( sx, sy ) ] ) ) {
+                const int bx = this->atom_x[ bond.iAtom ];
+                const int by = this->atom_y[ bond.iAtom ];
+                if( bond.range == Neighborhood::vonNeumann && ( bx < left || bx > right || by < top || by > bottom ) )
+                    return false;
+            }
+        }
+    }
     // overlap test along front edge:
     int x1, y1, x2, y2;
     if( dx == 1 )       { x1 = x2 = right;  y1 = top;  y2 = bottom; }
     else if( dx == -1 ) { x1 = x2 = left;   y1 = top;  y2 = bottom; }
     else if( dy == 1 )  { y1 = y2 = bottom; x1 = left; x2 = right;  }
     else if( dy == -1 ) { y1 = y2 = top;    x1 = left; x2 = right;  }
-    for( int sx = x1; sx <= x2; ++sx ) {
-        for( int sy = y1; sy <= y2; ++sy ) {
-            if( !this->grid[sx][sy].has_atom )
+    for( int sy = y1; sy <= y2; ++sy ) {
+        for( int sx = x1; sx <= x2; ++sx ) {
+            if( !this->occupied[ getCell( sx, sy ) ] )
                 continue;
             int tx = sx + dx;
             int ty = sy + dy;
-            if( isOffGrid(tx,ty) || this->grid[tx][ty].has_atom )
+            if( isOffGrid(tx,ty) || this->occupied[ getCell( tx, ty ) ] )
                 return false;
         }
     }
     // bond test along back and side edges:
     // TODO: improve test to reject leading edge
     // TODO: find better way of traversing non-leading edges
-    for( int sx = left; sx <= right; ++sx ) {
-        for( int sy = top; sy <= bottom; ++sy ) {
+    for( int sy = top; sy <= bottom; ++sy ) {
+        for( int sx = left; sx <= right; ++sx ) {
             if( sx > left && sx < right && sy > top && sy < bottom )
                 continue; // not on the edge of the block
-            if( !this->grid[sx][sy].has_atom )
+            if( !this->occupied[ getCell( sx, sy ) ] )
                 continue;
-            const Atom& a = this->atoms[ this->grid[sx][sy].iAtom ];
-            for( const Bond& bond : a.bonds ) {
-                const size_t iAtomB = bond.iAtom;
-                const Atom& b = this->atoms[ iAtomB ];
-                if( b.x >= left && b.x <= right && b.y >= top && b.y <= bottom )
+            for( const Bond& bond : getBonds( this->cell_atom[ getCell( sx, sy ) ] ) ) {
+                const int bx = this->atom_x[ bond.iAtom ];
+                const int by = this->atom_y[ bond.iAtom ];
+                if( bx >= left && bx <= right && by >= top && by <= bottom )
                     continue; // atom B is also within the block
-                if( !isWithinNeighborhood( bond.range, sx + dx, sy + dy, b.x, b.y ) )
+                if( !isWithinNeighborhood( bond.range, sx + dx, sy + dy, bx, by ) )
                     return false; // would over-stretch this bond
             }
         }
     }
-    // move the block
-    vector<size_t> movers;
-    for( int sx = left; sx <= right; ++sx ) {
-        for( int sy = top; sy <= bottom; ++sy ) {
-            if( !this->grid[sx][sy].has_atom )
-                continue;
-            movers.push_back( this->grid[sx][sy].iAtom );
-            this->grid[sx][sy].has_atom = false;
+    shiftBlock( left, top, right, bottom, dx, dy );
+    return true;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::shiftBlock( int left, int top, int right, int bottom, int dx, int dy ) {
+    // The front edge moves into cells outside the block, so only its atoms are copied across. The rest
+    // moves as whole spans of the rows of both planes, working back from the front so that nothing is
+    // overwritten before it has moved. The atoms' coordinates are updated from each span as it lands.
+    if( dx != 0 ) {
+        const int front = dx > 0 ? right : left;
+        const int back = dx > 0 ? left : right;
+        const size_t span = right - left; // the rest of each row
+        for( int y = top; y <= bottom; ++y ) {
+            const size_t from = getCell( front, y );
+            if( this->occupied[ from ] ) {
+                const size_t to = getCell( front + dx, y );
+                this->occupied[ to ] = true;
+                this->cell_atom[ to ] = this->cell_atom[ from ];
+                displaceAtom( this->cell_atom[ to ], dx, 0 );
+            }
+            const size_t source = getCell( dx > 0 ? left : left + 1, y );
+            const size_t target = getCell( dx > 0 ? left + 1 : left, y );
+            this->occupied.moveSpan( target, source, span );
+            this->cell_atom.moveSpan( target, source, span );
+            this->occupied[ getCell( back, y ) ] = false;
+            for( size_t cell = target; cell < target + span; ++cell ) {
+                if( this->occupied[ cell ] )
+                    displaceAtom( this->cell_atom[ cell ], dx, 0 );
+            }
         }
     }
-    for( const size_t& iAtom : movers ) {
-        Atom& a = this->atoms[ iAtom ];
-        a.x += dx;
-        a.y += dy;
-        if( isOffGrid( a.x, a.y ) )
-            throw exception("internal error");
-        Slot& slot = this->grid[ a.x ][ a.y ];
-        slot.has_atom = true;
-        slot.iAtom = iAtom;
+    else {
+        const int front = dy > 0 ? bottom : top;
+        const int back = dy > 0 ? top : bottom;
+        const size_t span = right - left + 1;
+        for( int x = left; x <= right; ++x ) {
+            const size_t from = getCell( x, front );
+            if( this->occupied[ from ] ) {
+                const size_t to = getCell( x, front + dy );
+                this->occupied[ to ] = true;
+                this->cell_atom[ to ] = this->cell_atom[ from ];
+                displaceAtom( this->cell_atom[ to ], 0, dy );
+            }
+        }
+        for( int y = front; y != back; y -= dy ) {
+            const size_t source = getCell( left, y - dy );
+            const size_t target = getCell( left, y );
+            this->occupied.moveSpan( target, source, span );
+            this->cell_atom.moveSpan( target, source, span );
+            for( size_t cell = target; cell < target + span; ++cell ) {
+                if( this->occupied[ cell ] )
+                    displaceAtom( this->cell_atom[ cell ], 0, dy );
+            }
+        }
+        this->occupied.fillSpan( getCell( left, back ), span, 0 );
     }
-    return true;
 }
 
 //----------------------------------------------------------------------------
 
-void Arena::moveBlocksInGroup( const Group& group ) {
+template<class Geometry>
+void ArenaT<Geometry>::moveBlocksInGroup( const Group& group ) {
     // get the bounding box
     int bb[4] = { INT_MAX, -INT_MAX, INT_MAX, -INT_MAX };
-    for( const size_t& iAtom : group.atoms ) {
-        const Atom& a = this->atoms[ iAtom ];
-        bb[0] = min( bb[0], a.x );
-        bb[1] = max( bb[1], a.x );
-        bb[2] = min( bb[2], a.y );
-        bb[3] = max( bb[3], a.y );
+    for( const AtomIndex& iAtom : group.atoms ) {
+        const int x = this->atom_x[ iAtom ];
+        const int y = this->atom_y[ iAtom ];
+        bb[0] = min( bb[0], x );
+        bb[1] = max( bb[1], x );
+        bb[2] = min( bb[2], y );
+        bb[3] = max( bb[3], y );
     }
     // let the whole block have a go at moving
     int dx, dy;
@@ -412,102 +1639,552 @@ void Arena::moveBlocksInGroup( const Group& group ) {
 
 //----------------------------------------------------------------------------
 
-bool Arena::moveMembersOfGroupInBlockIfPossible( const Group& group, int x, int y, int w, int h, int dx, int dy ) {
+template<class Geometry>
+bool ArenaT<Geometry>::moveMembersOfGroupInBlockIfPossible( const Group& group, int x, int y, int w, int h, int dx, int dy ) {
     // collect the atoms in this block that we want to move
-    vector<size_t> movers;
-    for( int sx = x; sx < x+w; ++sx ) {
-        for( int sy = y; sy < y+h; ++sy ) {
-            if( isOffGrid( sx, sy ) || !this->grid[sx][sy].has_atom )
+    vector<AtomIndex> movers;
+    for( int sy = y; sy < y+h; ++sy ) {
+        for( int sx = x; sx < x+w; ++sx ) {
+            if( isOffGrid( sx, sy ) || !this->occupied[ getCell( sx, sy ) ] )
                 continue; // not an atom here
-            const size_t iAtom = this->grid[sx][sy].iAtom;
-            if( find( group.atoms.begin(), group.atoms.end(), iAtom ) == group.atoms.end() )
+            const AtomIndex iAtom = this->cell_atom[ getCell( sx, sy ) ];
+            if( !binary_search( group.atoms.begin(), group.atoms.end(), iAtom ) )
                 continue; // not one of our group's atoms
-            int tx = sx + dx;
-            int ty = sy + dy;
-            if( isOffGrid( tx, ty ) )
-                return false; // can't move off-grid
             movers.push_back( iAtom );
         }
     }
+    return moveAtomsIfPossible( movers, dx, dy );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::moveAtomsIfPossible( vector<AtomIndex>& movers, int dx, int dy ) {
+    // rigid clusters can only move as a whole, so any members outside the block come along too
+    if( this->is_mover.size() < getNumberOfAtoms() )
+        this->is_mover.resize( getNumberOfAtoms(), 0 );
+    for( const AtomIndex& iAtom : movers )
+        this->is_mover[ iAtom ] = 1;
+    vector<AtomIndex> clusters;
+    const size_t num_requested = movers.size();
+    for( size_t iMover = 0; iMover < num_requested; ++iMover ) {
+        const AtomIndex c = this->rigid_cluster[ movers[ iMover ] ];
+        if( c == NO_CLUSTER || find( clusters.begin(), clusters.end(), c ) != clusters.end() )
+            continue;
+        clusters.push_back( c );
+        for( const AtomIndex& iAtom : this->rigid_clusters[ c ].atoms ) {
+            if( this->is_mover[ iAtom ] )
+                continue;
+            this->is_mover[ iAtom ] = 1;
+            movers.push_back( iAtom );
+        }
+    }
+    bool all_ok = isMovableSet( movers );
+    // off-grid check
+    for( size_t iMover = 0; all_ok && iMover < movers.size(); ++iMover ) {
+        if( isOffGrid( this->atom_x[ movers[ iMover ] ] + dx, this->atom_y[ movers[ iMover ] ] + dy ) )
+            all_ok = false;
+    }
     // bond check
-    for( const size_t& iAtom : movers ) {
-        const Atom& a = this->atoms[ iAtom ];
-        for( const Bond& bond : a.bonds ) {
-            const size_t iAtomB = bond.iAtom;
-            if( find( movers.begin(), movers.end(), iAtomB ) != movers.end() )
+    for( size_t iMover = 0; all_ok && iMover < movers.size(); ++iMover ) {
+        const AtomIndex iAtom = movers[ iMover ];
+        for( const Bond& bond : getBonds( iAtom ) ) {
+            const AtomIndex iAtomB = bond.iAtom;
+            if( this->is_mover[ iAtomB ] )
                 continue; // no problem, since B is also part of the moving set
-            const Atom& b = this->atoms[ iAtomB ];
-            if( !isWithinNeighborhood( bond.range, a.x + dx, a.y + dy, b.x, b.y ) )
-                return false; // would over-stretch this bond
+            if( !isWithinNeighborhood( bond.range, this->atom_x[ iAtom ] + dx, this->atom_y[ iAtom ] + dy,
+                                       this->atom_x[ iAtomB ], this->atom_y[ iAtomB ] ) ) {
+                all_ok = false; // would over-stretch this bond
+                break;
+            }
         }
     }
     // overlap check: 
     // simple implementation for now: remove from grid and try to place in the new position, else replace
-    for( const size_t& iAtom : movers ) {
-        const Atom &atom = this->atoms[ iAtom ];
-        this->grid[ atom.x ][ atom.y ].has_atom = false;
+    if( all_ok ) {
+        for( const AtomIndex& iAtom : movers ) {
+            this->occupied[ getCell( this->atom_x[ iAtom ], this->atom_y[ iAtom ] ) ] = false;
+        }
+        for( const AtomIndex& iAtom : movers ) {
+            int tx = this->atom_x[ iAtom ] + dx;
+            int ty = this->atom_y[ iAtom ] + dy;
+            if( this->occupied[ getCell( tx, ty ) ] ) {
+                all_ok = false;
+                break;
+            }
+        }
+        if( !all_ok ) {
+            dx = dy = 0;
+        }
+        for( const AtomIndex& iAtom : movers ) {
+            displaceAtom( iAtom, dx, dy );
+            const size_t cell = getCell( this->atom_x[ iAtom ], this->atom_y[ iAtom ] );
+            this->occupied[ cell ] = true;
+            this->cell_atom[ cell ] = iAtom;
+        }
     }
-    bool all_ok = true;
-    for( const size_t& iAtom : movers ) {
-        const Atom &a = this->atoms[ iAtom ];
-        int tx = a.x + dx;
-        int ty = a.y + dy;
-        if( this->grid[ tx ][ ty ].has_atom ) {
-            all_ok = false;
-            break;
+    for( const AtomIndex& iAtom : movers )
+        this->is_mover[ iAtom ] = 0;
+    return all_ok;
+}
+                                
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::moveSectionsOfGroup( size_t iGroup ) {
+    // (the groups are only written to if the sections need computing, so a fork keeps sharing them)
+    if( !getGroups()[ iGroup ].has_sections )
+        computeSections( getWritableGroups()[ iGroup ] );
+    const Group& group = getGroups()[ iGroup ];
+    // let the whole molecule have a go at moving
+    int dx, dy;
+    getRandomMove( this->movement_neighborhood, dx, dy );
+    vector<AtomIndex> movers( group.atoms );
+    moveAtomsIfPossible( movers, dx, dy );
+    // then each of its sections
+    for( const auto& section : group.sections ) {
+        getRandomMove( this->movement_neighborhood, dx, dy );
+        movers.assign( section.begin(), section.end() );
+        moveAtomsIfPossible( movers, dx, dy );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::computeSections( Group& group ) const {
+    // The sections are the parts of the molecule most likely to be able to move on their own:
+    // - each rigid cluster or lone atom
+    // - each pair of these joined by a flexible bond
+    // - the smaller side of each flexible bond that would split the molecule if broken (e.g. an arm)
+    const vector<AtomIndex>& atoms = group.atoms;
+    const size_t n = atoms.size();
+    vector<vector<AtomIndex>>& sections = group.sections;
+    sections.clear();
+    group.has_sections = true;
+    if( n < 2 )
+        return; // the whole molecule is the only section
+
+    class MemberIndex {
+        public:
+            MemberIndex( const vector<AtomIndex>& atoms ) : atoms(atoms) {}
+            size_t operator() (AtomIndex iAtom) const { return lower_bound( atoms.begin(), atoms.end(), iAtom ) - atoms.begin(); }
+        private:
+            const vector<AtomIndex>& atoms;
+    };
+    const MemberIndex member( atoms );
+
+    // rigid clusters and lone atoms, and the flexible pairs
+    vector<AtomIndex> unit_a, unit_b;
+    for( size_t i = 0; i < n; ++i ) {
+        const AtomIndex iAtom = atoms[ i ];
+        const AtomIndex c = this->rigid_cluster[ iAtom ];
+        if( c == NO_CLUSTER )
+            sections.push_back( vector<AtomIndex>( 1, iAtom ) );
+        else if( this->rigid_clusters[ c ].atoms.front() == iAtom )
+            sections.push_back( this->rigid_clusters[ c ].atoms );
+        for( const Bond& bond : getBonds( iAtom ) ) {
+            if( bond.range == Neighborhood::vonNeumann || bond.iAtom < iAtom )
+                continue;
+            const AtomIndex cb = this->rigid_cluster[ bond.iAtom ];
+            if( c != NO_CLUSTER && c == cb )
+                continue; // both ends are in the same rigid cluster already
+            unit_a = ( c == NO_CLUSTER ) ? vector<AtomIndex>( 1, iAtom ) : this->rigid_clusters[ c ].atoms;
+            unit_b = ( cb == NO_CLUSTER ) ? vector<AtomIndex>( 1, bond.iAtom ) : this->rigid_clusters[ cb ].atoms;
+            unit_a.insert( unit_a.end(), unit_b.begin(), unit_b.end() );
+            sections.push_back( unit_a );
         }
     }
-    if( !all_ok ) {
-        dx = dy = 0;
+
+    // find the bridges with an iterative depth-first search, recording each subtree as a range of the visit order
+    vector<size_t> visit_time( n, SIZE_MAX ), low( n ), subtree_size( n, 1 ), parent( n, SIZE_MAX ), order, bridges;
+    vector<pair<size_t,int>> stack; // (member, next bond to look at)
+    order.reserve( n );
+    visit_time[ 0 ] = low[ 0 ] = 0;
+    order.push_back( 0 );
+    stack.push_back( make_pair( size_t( 0 ), 0 ) );
+    while( !stack.empty() ) {
+        const size_t u = stack.back().first;
+        const BondList list = getBonds( atoms[ u ] );
+        if( stack.back().second < int( list.size() ) ) {
+            const size_t v = member( list[ stack.back().second++ ].iAtom );
+            if( visit_time[ v ] == SIZE_MAX ) {
+                visit_time[ v ] = low[ v ] = order.size();
+                order.push_back( v );
+                parent[ v ] = u;
+                stack.push_back( make_pair( v, 0 ) );
+            }
+            else if( v != parent[ u ] )
+                low[ u ] = min( low[ u ], visit_time[ v ] );
+            continue;
+        }
+        stack.pop_back();
+        const size_t p = parent[ u ];
+        if( p == SIZE_MAX )
+            continue;
+        low[ p ] = min( low[ p ], low[ u ] );
+        subtree_size[ p ] += subtree_size[ u ];
+        if( low[ u ] > visit_time[ p ] && !hasRigidBond( atoms[ u ], atoms[ p ] ) )
+            bridges.push_back( u ); // (bridges inside a rigid cluster don't count)
+    }
+    // the subtree below each bridge is one side of it, the rest of the molecule is the other
+    for( const size_t& u : bridges ) {
+        vector<AtomIndex> side;
+        const size_t first = visit_time[ u ];
+        const size_t last = first + subtree_size[ u ];
+        if( 2 * subtree_size[ u ] <= n ) {
+            for( size_t i = first; i < last; ++i )
+                side.push_back( atoms[ order[ i ] ] );
+        }
+        else {
+            for( size_t i = 0; i < order.size(); ++i ) {
+                if( i < first || i >= last )
+                    side.push_back( atoms[ order[ i ] ] );
+            }
+        }
+        sections.push_back( side );
+    }
+
+    // remove duplicates, and the whole molecule since that is always tried anyway
+    for( auto& section : sections )
+        sort( section.begin(), section.end() );
+    sort( sections.begin(), sections.end() );
+    sections.erase( unique( sections.begin(), sections.end() ), sections.end() );
+    sections.erase( remove( sections.begin(), sections.end(), atoms ), sections.end() );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::moveSectionsKinetically() {
+    // Rejection-free (n-fold way) kinetic Monte Carlo over the same moves as MPEGSections: each molecule and
+    // section tries each direction at a rate of 1/4 per update. Rather than proposing moves that mostly fail
+    // when crowded, we keep the list of moves that are currently possible, pick from it directly and advance
+    // the clock by an exponentially distributed waiting time.
+    const double end_time = this->kinetic_time + 1.0;
+    while( true ) {
+        if( !this->kinetic_moves_valid )
+            buildKineticMoves();
+        if( this->feasible_moves.empty() )
+            break; // everything is jammed
+        const double total_rate = this->feasible_moves.size() / 4.0;
+        const double wait = -log( getRandUniform() ) / total_rate;
+        if( this->kinetic_time + wait > end_time )
+            break; // (the waiting time is memoryless so we can simply start again next update)
+        this->kinetic_time += wait;
+        const KineticMove move = this->feasible_moves[ getRandIndex( this->feasible_moves.size() ) ];
+        const int dx = KINETIC_DX[ move.iMove % 4 ];
+        const int dy = KINETIC_DY[ move.iMove % 4 ];
+        vector<AtomIndex>& movers = this->kinetic_movers;
+        movers = getMoverAtoms( move.iGroup, move.iMove / 4 ); // (reusing the space)
+        if( !moveAtomsIfPossible( movers, dx, dy ) )
+            throw runtime_error("Kinetic move was not possible");
+        updateKineticMoves( movers, dx, dy );
+    }
+    this->kinetic_time = end_time;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::buildKineticMoves() {
+    TRACE_SCOPE("buildKineticMoves");
+    // from here on the moves are kept up to date as atoms and bonds change, until something renumbers
+    // the atoms or changes them in bulk
+    this->kinetic_groups.assign( getGroups().size(), KineticGroup() );
+    this->feasible_moves.clear();
+    this->kinetic_moves_valid = true;
+    for( size_t iGroup = 0; iGroup < getGroups().size(); ++iGroup )
+        addKineticMoves( iGroup );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::addKineticMoves( size_t iGroup ) {
+    // the molecule and each of its sections is a mover
+    if( !getGroups()[ iGroup ].has_sections )
+        computeSections( getWritableGroups()[ iGroup ] );
+    const Group& group = getGroups()[ iGroup ];
+    // index the sections by the members they contain
+    KineticGroup& kg = this->kinetic_groups[ iGroup ];
+    kg.section_start.assign( group.atoms.size() + 1, 0 );
+    for( const vector<AtomIndex>& section : group.sections ) {
+        for( const AtomIndex& iAtom : section )
+            kg.section_start[ lower_bound( begin( group.atoms ), end( group.atoms ), iAtom ) - begin( group.atoms ) + 1 ]++;
+    }
+    for( size_t iMember = 0; iMember < group.atoms.size(); ++iMember )
+        kg.section_start[ iMember + 1 ] += kg.section_start[ iMember ];
+    kg.section_of_member.resize( kg.section_start.back() );
+    vector<uint32_t> next( kg.section_start.begin(), kg.section_start.end() - 1 );
+    for( uint32_t iSection = 0; iSection < group.sections.size(); ++iSection ) {
+        for( const AtomIndex& iAtom : group.sections[ iSection ] )
+            kg.section_of_member[ next[ lower_bound( begin( group.atoms ), end( group.atoms ), iAtom ) - begin( group.atoms ) ]++ ] = iSection;
+    }
+    // find which moves are possible
+    kg.feasible_position.assign( 4 * ( group.sections.size() + 1 ), NOT_FEASIBLE );
+    for( uint32_t iMove = 0; iMove < kg.feasible_position.size(); ++iMove ) {
+        const vector<AtomIndex>& atoms = getMoverAtoms( uint32_t( iGroup ), iMove / 4 );
+        setMoveFeasible( uint32_t( iGroup ), iMove, canMoveAtoms( atoms, KINETIC_DX[ iMove % 4 ], KINETIC_DY[ iMove % 4 ] ) );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::removeKineticMoves( size_t iGroup ) {
+    // (before the molecule's atoms or bonds change)
+    KineticGroup& kg = this->kinetic_groups[ iGroup ];
+    for( uint32_t iMove = 0; iMove < kg.feasible_position.size(); ++iMove )
+        setMoveFeasible( uint32_t( iGroup ), iMove, false );
+    kg.section_start.clear();
+    kg.section_of_member.clear();
+    kg.feasible_position.clear();
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::updateKineticMoves( const vector<AtomIndex>& moved, int dx, int dy ) {
+    // a move can only change what is possible for movers that share atoms with it or are bonded to it,
+    // and for those with atoms next to a position it vacated or filled, only in the direction of that position
+    vector<AffectedMover>& affected = this->affected_movers;
+    affected.clear();
+    for( const AtomIndex& iAtom : moved ) {
+        addAffectedMovers( iAtom, 0xF, affected );
+        for( const Bond& bond : getBonds( iAtom ) )
+            addAffectedMovers( bond.iAtom, 0xF, affected );
+        for( int iEnd = 0; iEnd < 2; ++iEnd ) {
+            const int x = this->atom_x[ iAtom ] - iEnd * dx;
+            const int y = this->atom_y[ iAtom ] - iEnd * dy;
+            for( int iDir = 0; iDir < 4; ++iDir ) {
+                const int nx = x + KINETIC_DX[ iDir ];
+                const int ny = y + KINETIC_DY[ iDir ];
+                if( !isOffGrid( nx, ny ) && this->occupied[ getCell( nx, ny ) ] )
+                    addAffectedMovers( this->cell_atom[ getCell( nx, ny ) ], uint8_t( 1 << ( ( iDir + 2 ) % 4 ) ), affected );
+            }
+        }
+    }
+    recheckMovers( affected );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::updateKineticMovesAround( int x, int y ) {
+    // an atom has appeared or disappeared at (x,y), which only matters to its neighbors' moves towards it
+    vector<AffectedMover>& affected = this->affected_movers;
+    affected.clear();
+    for( int iDir = 0; iDir < 4; ++iDir ) {
+        const int nx = x + KINETIC_DX[ iDir ];
+        const int ny = y + KINETIC_DY[ iDir ];
+        if( !isOffGrid( nx, ny ) && this->occupied[ getCell( nx, ny ) ] )
+            addAffectedMovers( this->cell_atom[ getCell( nx, ny ) ], uint8_t( 1 << ( ( iDir + 2 ) % 4 ) ), affected );
+    }
+    recheckMovers( affected );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::addAffectedMovers( AtomIndex iAtom, uint8_t directions, vector<AffectedMover>& affected ) const {
+    // the atom's molecule and the sections containing it
+    const uint32_t iGroup = this->atom_group[ iAtom ];
+    const KineticGroup& kg = this->kinetic_groups[ iGroup ];
+    const AffectedMover molecule = { iGroup, 0, directions };
+    affected.push_back( molecule );
+    if( kg.section_of_member.empty() )
+        return; // (as for every lone atom)
+    const vector<AtomIndex>& atoms = getGroups()[ iGroup ].atoms;
+    const size_t iMember = lower_bound( begin( atoms ), end( atoms ), iAtom ) - begin( atoms );
+    for( uint32_t i = kg.section_start[ iMember ]; i < kg.section_start[ iMember + 1 ]; ++i ) {
+        const AffectedMover section = { iGroup, kg.section_of_member[ i ] + 1, directions };
+        affected.push_back( section );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::recheckMovers( vector<AffectedMover>& affected ) {
+    // each mover once, in each of the directions asked for
+    sort( begin( affected ), end( affected ) );
+    for( size_t i = 0; i < affected.size(); ) {
+        const uint32_t iGroup = affected[ i ].iGroup;
+        const uint32_t iMover = affected[ i ].iMover;
+        uint8_t directions = 0;
+        for( ; i < affected.size() && affected[ i ].iGroup == iGroup && affected[ i ].iMover == iMover; ++i )
+            directions |= affected[ i ].directions;
+        const vector<AtomIndex>& atoms = getMoverAtoms( iGroup, iMover );
+        for( int iDir = 0; iDir < 4; ++iDir ) {
+            if( directions & ( 1 << iDir ) )
+                setMoveFeasible( iGroup, 4 * iMover + iDir, canMoveAtoms( atoms, KINETIC_DX[ iDir ], KINETIC_DY[ iDir ] ) );
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void ArenaT<Geometry>::setMoveFeasible( uint32_t iGroup, uint32_t iMove, bool feasible ) {
+    // the list is unordered so entries can be added and removed in constant time
+    uint32_t& position = this->kinetic_groups[ iGroup ].feasible_position[ iMove ];
+    if( feasible == ( position != NOT_FEASIBLE ) )
+        return; // no change
+    if( feasible ) {
+        position = uint32_t( this->feasible_moves.size() );
+        const KineticMove move = { iGroup, iMove };
+        this->feasible_moves.push_back( move );
+    }
+    else {
+        const KineticMove last = this->feasible_moves.back();
+        this->feasible_moves[ position ] = last;
+        this->kinetic_groups[ last.iGroup ].feasible_position[ last.iMove ] = position;
+        this->feasible_moves.pop_back();
+        position = NOT_FEASIBLE;
     }
-    for( const size_t& iAtom : movers ) {
-        Atom &a = this->atoms[ iAtom ];
-        a.x += dx;
-        a.y += dy;
-        this->grid[ a.x ][ a.y ].has_atom = true;
-        this->grid[ a.x ][ a.y ].iAtom = iAtom;
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::canMoveAtoms( const vector<AtomIndex>& atoms, int dx, int dy ) {
+    // the same tests as moveAtomsIfPossible, for a set that already includes whole rigid clusters
+    if( this->is_mover.size() < getNumberOfAtoms() )
+        this->is_mover.resize( getNumberOfAtoms(), 0 );
+    for( const AtomIndex& iAtom : atoms )
+        this->is_mover[ iAtom ] = 1;
+    bool all_ok = isMovableSet( atoms );
+    for( size_t i = 0; all_ok && i < atoms.size(); ++i ) {
+        const AtomIndex iAtom = atoms[ i ];
+        const int tx = this->atom_x[ iAtom ] + dx;
+        const int ty = this->atom_y[ iAtom ] + dy;
+        if( isOffGrid( tx, ty ) || ( this->occupied[ getCell( tx, ty ) ] && !this->is_mover[ this->cell_atom[ getCell( tx, ty ) ] ] ) ) {
+            all_ok = false; // off-grid or overlapping
+            break;
+        }
+        for( const Bond& bond : getBonds( iAtom ) ) {
+            if( !this->is_mover[ bond.iAtom ] && !isWithinNeighborhood( bond.range, tx, ty,
+                    this->atom_x[ bond.iAtom ], this->atom_y[ bond.iAtom ] ) ) {
+                all_ok = false; // would over-stretch this bond
+                break;
+            }
+        }
     }
+    for( const AtomIndex& iAtom : atoms )
+        this->is_mover[ iAtom ] = 0;
     return all_ok;
 }
-                                
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::isMovableSet( const vector<AtomIndex>& atoms ) const {
+    // Frozen atoms can only move if they are borrowable, along with a set whose topmost atom is in the
+    // movable rows. So a set straddling the boundary between two arenas that each freeze the other's rows
+    // (see DomainStrip) is only ever moved by the one holding its topmost atom.
+    bool has_frozen = false;
+    int top = INT_MAX;
+    for( const AtomIndex& iAtom : atoms ) {
+        if( isFrozen( iAtom ) ) {
+            if( !this->borrowable[ iAtom ] )
+                return false;
+            has_frozen = true;
+        }
+        top = min( top, int( this->atom_y[ iAtom ] ) );
+    }
+    return !has_frozen || ( top >= this->movable_first_row && top < this->movable_end_row );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+const vector<ArenaBase::AtomIndex>& ArenaT<Geometry>::getMoverAtoms( uint32_t iGroup, uint32_t iMover ) const {
+    // mover 0 is the whole molecule, else sections[iMover-1]
+    const Group& group = getGroups()[ iGroup ];
+    return iMover == 0 ? group.atoms : group.sections[ iMover - 1 ];
+}
+
 //----------------------------------------------------------------------------
 
-int Arena::getRandIntInclusive( int a, int b )
+int ArenaBase::getRandIntInclusive( int a, int b )
 {
     return a + rand() % ( b - a + 1 );
 }
 
 //----------------------------------------------------------------------------
 
-void Arena::combineGroupsInvolvingTheseIntoOne( size_t a, size_t b ) {
-    // find every group involving a or b
-    vector<size_t> groups_to_be_merged;
-	for( size_t iGroup = 0; iGroup < this->groups.size(); ++iGroup ) {
-        const Group& g = this->groups[ iGroup ];
-		if( find( begin( g.atoms ), end( g.atoms ), a ) != end( g.atoms ) ||
-                find( begin( g.atoms ), end( g.atoms ), b ) != end( g.atoms ) )
-            groups_to_be_merged.push_back( iGroup );
-    }
-    if( groups_to_be_merged.size() < 2 )
-        return; // nothing to do
+size_t ArenaBase::getRandIndex( size_t n )
+{
+    // RAND_MAX can be as small as 32767, so combine enough calls to cover n
+    size_t r = 0;
+    for( size_t range = 1; range < n; range *= size_t( RAND_MAX ) + 1 )
+        r = r * ( size_t( RAND_MAX ) + 1 ) + size_t( rand() );
+    return r % n;
+}
+
+//----------------------------------------------------------------------------
+
+double ArenaBase::getRandUniform()
+{
+    // in (0,1], so that its log is finite
+    return ( rand() + 1.0 ) / ( RAND_MAX + 1.0 );
+}
+
+//----------------------------------------------------------------------------
 
-	Group& g = this->groups[ groups_to_be_merged.front() ];
-    for( size_t iiGroup = 1; iiGroup < groups_to_be_merged.size(); ++iiGroup ) {
-        const Group& gb = this->groups[ groups_to_be_merged[ iiGroup ] ];
-        vector<size_t> merged_atoms( g.atoms.size() + gb.atoms.size() );
-        const auto& end = set_union( g.atoms.begin(), g.atoms.end(), gb.atoms.begin(), gb.atoms.end(), merged_atoms.begin() );
-        merged_atoms.resize( end - merged_atoms.begin() );
-        g.atoms.assign( merged_atoms.begin(), merged_atoms.end() );
+template<class Geometry>
+void ArenaT<Geometry>::combineGroupsInvolvingTheseIntoOne( AtomIndex a, AtomIndex b ) {
+    size_t ia = this->atom_group[ a ];
+    size_t ib = this->atom_group[ b ];
+    if( this->kinetic_moves_valid )
+        removeKineticMoves( ia );
+    getWritableGroups()[ ia ].has_sections = false; // the molecule's bond graph has changed
+    if( ia == ib ) {
+        if( this->kinetic_moves_valid )
+            addKineticMoves( ia );
+        return; // nothing else to do
     }
-    for( size_t iiGroup = groups_to_be_merged.size()-1; iiGroup >= 1; --iiGroup ) {
-        this->groups.erase( this->groups.begin() + groups_to_be_merged[ iiGroup  ] );
+    if( this->kinetic_moves_valid )
+        removeKineticMoves( ib );
+    // move the members of the smaller molecule into the larger one
+    if( getGroups()[ ia ].atoms.size() < getGroups()[ ib ].atoms.size() )
+        swap( ia, ib );
+    Group& g = getWritableGroups()[ ia ];
+    const Group& gb = getGroups()[ ib ];
+    TRACE_SCOPE_VALUE("combineGroups", g.atoms.size() + gb.atoms.size());
+
+    countMolecule( g.atoms.size(), -1 );
+    countMolecule( gb.atoms.size(), -1 );
+    vector<AtomIndex> merged_atoms( g.atoms.size() + gb.atoms.size() );
+    const auto& end = set_union( g.atoms.begin(), g.atoms.end(), gb.atoms.begin(), gb.atoms.end(), merged_atoms.begin() );
+    merged_atoms.resize( end - merged_atoms.begin() );
+    g.atoms.swap( merged_atoms );
+    g.has_sections = false;
+    countMolecule( g.atoms.size(), +1 );
+    for( const AtomIndex& iAtom : gb.atoms )
+        this->atom_group[ iAtom ] = AtomIndex( ia );
+    removeGroup( ib ); // (which may move the combined molecule into its place)
+    if( this->kinetic_moves_valid )
+        addKineticMoves( this->atom_group[ a ] );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+bool ArenaT<Geometry>::hasRigidBond( AtomIndex a, AtomIndex b ) const {
+    for( const Bond& bond : getBonds( a ) ) {
+        if( bond.iAtom == b )
+            return bond.range == Neighborhood::vonNeumann;
     }
+    return false;
 }
 
 //----------------------------------------------------------------------------
 
-bool Arena::hasBond( size_t a, size_t b ) const {
-    for( const Bond& bond : this->atoms[ a ].bonds ) {
+template<class Geometry>
+bool ArenaT<Geometry>::hasBond( AtomIndex a, AtomIndex b ) const {
+    for( const Bond& bond : getBonds( a ) ) {
         if( bond.iAtom == b )
             return true;
     }
@@ -515,3 +2192,8 @@ bool Arena::hasBond( size_t a, size_t b ) const {
 }
 
 //----------------------------------------------------------------------------
+
+// the shapes we build for, see Arena.hpp
+template class ArenaT<DynamicGeometry>;
+template class ArenaT<PowerOfTwoGeometry<10,10>>;
+template class ArenaT<PowerOfTwoGeometry<12,12>>;
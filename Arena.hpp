@@ -1,72 +1,288 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+// local:
+#include "ArenaGeometry.hpp"
+#include "CopyOnWriteVector.hpp"
+
 // STL:
 #include <vector>
+#include <string>
+#include <cstdint>
+#include <memory>
+
+// the capacity of each atom's bond list (the first couple are stored with the atom, see BondSlots)
+#ifndef GRID_PHYSICS_MAX_BONDS
+    #define GRID_PHYSICS_MAX_BONDS 8
+#endif
+
+// the storage of the atoms and grid, which forks only share when built with GRID_PHYSICS_COPY_ON_WRITE
+// (it makes every access a little slower)
+#ifdef GRID_PHYSICS_COPY_ON_WRITE
+    template<class T, int LOG2_CHUNK_SIZE = 12> using ArenaVector = CopyOnWriteVector<T,LOG2_CHUNK_SIZE>;
+#else
+    template<class T, int LOG2_CHUNK_SIZE = 12> using ArenaVector = ContiguousVector<T>;
+#endif
+
+class Chemistry;
 
-// Arena is a square grid world containing atoms
-class Arena {
+// ArenaBase holds the parts of an Arena that don't depend on its geometry
+class ArenaBase {
 
 	public:
-        
-        Arena( int x, int y );
 
-        // public typedefs                  // as squared Euclidean distance r2:
-        enum Neighborhood { vonNeumann      // r2 <= 1
+        // public typedefs
+        enum MovementMethod { JustAtoms      // atoms can move individually
+                            , AllGroups      // all subgraphs of atoms can move individually
+                            , MPEGSpace      // space itself moves around in large blocks
+                            , MPEGMolecules  // molecules are divided spatially into movement blocks on the fly
+                            , MPEGSections   // molecules are divided into cached sections along their bond graph
+                            , KineticSections // as MPEGSections, but moves are picked only from those currently possible
+                            };
+        typedef uint32_t AtomIndex;
+#ifdef GRID_PHYSICS_WIDE_COORDINATES
+        typedef int32_t Coordinate;         // for worlds wider or taller than 32767
+#else
+        typedef int16_t Coordinate;
+#endif
+        static const int MAX_BONDS = GRID_PHYSICS_MAX_BONDS;
+        static const AtomIndex MAX_ATOMS = ( 1u << 29 ) - 1; // (bonds are stored with the range in the top bits of the index)
+        static const AtomIndex NO_CLUSTER = UINT32_MAX;
+
+                                            // as squared Euclidean distance r2:
+        enum Neighborhood : uint8_t 
+                          { vonNeumann      // r2 <= 1
                           , Moore           // r2 <= 2
                           , vonNeumann2     // r2 <= 4
                           , knight          // r2 <= 5
                           , Moore2          // r2 <= 8
                           };
-        struct Bond { size_t iAtom; Neighborhood range; };
-        struct Atom { int x, y; int type; std::vector<Bond> bonds; };
+        struct Bond { AtomIndex iAtom; Neighborhood range; };
+        struct Atom { int x, y; int type; std::vector<Bond> bonds; }; // a copy, assembled by getAtom
+        struct AtomHandle { AtomIndex iAtom; unsigned int generation; }; // invalidated when the atom is removed or renumbered
+        struct AtomSpec { int x, y; int type; };
+        struct BondSpec { size_t a, b; Neighborhood range; };
+
+        // neighborhood names, as used in files
+        static Neighborhood getNeighborhood( const std::string& name );
+        static const char* getNeighborhoodName( Neighborhood range );
+
+    protected:
+
+        // a bond as stored, in four bytes
+        typedef uint32_t PackedBond;
+        static PackedBond packBond( AtomIndex iAtom, Neighborhood range ) { return iAtom | ( uint32_t( range ) << 29 ); }
+        static Bond unpackBond( PackedBond bond ) { Bond b = { bond & MAX_ATOMS, Neighborhood( bond >> 29 ) }; return b; }
+
+        // useful functions
+        static bool isWithinNeighborhood( Neighborhood type, int x1, int y1, int x2, int y2 );
+        static int getRandIntInclusive( int a, int b );
+        static size_t getRandIndex( size_t n );
+        static double getRandUniform();
+        static uint64_t getMortonKey( int x, int y );
+        static void getRandomMove( Neighborhood nhood, int& dx, int& dy );
+};
+
+// ArenaT is a rectangular grid world containing atoms, with the shape given by Geometry (see ArenaGeometry.hpp)
+//
+// The code is the same for every geometry, and is instantiated in Arena.cpp for the ones typedef'd below.
+template<class Geometry>
+class ArenaT : public ArenaBase {
+
+	public:
+
+        // public typedefs
+        class BondIterator { public:
+                                 BondIterator( const PackedBond* p ) : p( p ) {}
+                                 Bond operator*() const { return unpackBond( *p ); }
+                                 BondIterator& operator++() { ++p; return *this; }
+                                 bool operator!=( const BondIterator& other ) const { return p != other.p; }
+                             private:
+                                 const PackedBond* p; };
+        struct BondList { const PackedBond *first, *last; // a view of an atom's bonds, see getBonds
+                          BondIterator begin() const { return BondIterator( first ); }
+                          BondIterator end() const { return BondIterator( last ); }
+                          size_t size() const { return last - first; }
+                          Bond operator[]( size_t i ) const { return unpackBond( first[ i ] ); } };
+
+        ArenaT( int x, int y, MovementMethod method = MPEGMolecules );
 
 		size_t addAtom( int x, int y, int type );
 		void makeBond( size_t a, size_t b, Neighborhood range );
+        size_t addAtoms( const std::vector<AtomSpec>& atoms ); // returns the index of the first, the rest follow on
+        void addBonds( const std::vector<BondSpec>& bonds );   // cheaper than calling makeBond for each
+        void removeAtom( const AtomHandle& a );
+        void breakBond( const AtomHandle& a, const AtomHandle& b );
+        void compact(); // renumbers the live atoms contiguously, invalidating all indices and handles
+        void sortAtomsSpatially(); // as compact() but renumbers along a Z-order curve, for memory locality
+        // A copy of the world. Only when built with GRID_PHYSICS_COPY_ON_WRITE does it share the storage of
+        // the atoms and grid with this one until either changes it (see ArenaVector); otherwise that storage
+        // is copied in full, so each fork costs as much memory as the original. In either build the groups are
+        // shared until either adds, removes or changes one, when they are copied in full.
+        ArenaT fork() const { return *this; }
+        void setSpatialSortInterval( int n ) { this->spatial_sort_interval = n; } // 0 to disable
+        void setChemistry( const Chemistry& chemistry );
+        void setMovableRows( int first, int end ); // atoms outside these rows are frozen in place, and don't react with each other
+        void setBorrowable( size_t i, bool borrowable ); // lets a frozen atom move along with unfrozen ones, see isMovableSet
         void update();
 
         // accessors
-        bool isOffGrid( int x, int y ) const;
+        bool isOffGrid( int x, int y ) const { return this->geometry.isOffGrid( x, y ); }
         bool hasAtom( int x, int y ) const;
-        int getArenaWidth() const { return this->X; }
-        int getArenaHeight() const { return this->Y; }
-        size_t getNumberOfAtoms() const { return this->atoms.size(); }
-        Atom getAtom( size_t i ) const { return this->atoms[i]; }
-        size_t getNumberOfGroups() const { return this->groups.size(); }
+        int getArenaWidth() const { return this->geometry.getWidth(); }
+        int getArenaHeight() const { return this->geometry.getHeight(); }
+        size_t getNumberOfAtoms() const { return this->atom_type.size(); } // includes the free slots of removed atoms
+        size_t getNumberOfLiveAtoms() const { return this->atom_type.size() - this->free_atoms.size(); }
+        bool isLiveAtom( size_t i ) const { return this->atom_generation[i] != 0; }
+        Atom getAtom( size_t i ) const;
+        int getAtomX( size_t i ) const { return this->atom_x[ i ]; } // (these are cheaper than getAtom, which copies the bonds)
+        int getAtomY( size_t i ) const { return this->atom_y[ i ]; }
+        int getAtomType( size_t i ) const { return this->atom_type[ i ]; }
+        BondList getBonds( AtomIndex i ) const { const PackedBond* first = this->num_bonds[ i ] > INLINE_BONDS ?
+                                                     this->bond_overflow[ this->bonds[ i ].slots[ 0 ] ].slots : this->bonds[ i ].slots;
+                                                 BondList list = { first, first + this->num_bonds[ i ] }; return list; } // (until they change)
+        size_t getAtomAt( int x, int y ) const;
+        AtomHandle getHandle( size_t i ) const;
+        bool isValid( const AtomHandle& a ) const;
+        size_t getNumberOfGroups() const { return getGroups().size(); }
+        double getKineticTime() const { return this->kinetic_time; } // (for KineticSections) simulated time, in updates
+
+        // observables, kept up to date as the world changes
+        void getDisplacement( size_t i, int& dx, int& dy ) const;  // since the atom was added, or resetDisplacements
+        double getMeanSquaredDisplacement() const;                  // over the live atoms
+        void resetDisplacements();
+        std::vector<size_t> getClusterSizeCounts() const;           // the number of molecules of each size, indexed by size
+        size_t getNumberOfBonds( Neighborhood range ) const { return this->bond_range_count[ range ]; }
 	
 	private:
 
         // typedefs
-        struct Group { std::vector<size_t> atoms; };
-        struct Slot { bool has_atom; size_t iAtom; Slot() : has_atom( false ) {} };
-        enum MovementMethod { JustAtoms      // atoms can move individually
-                            , AllGroups      // all subgraphs of atoms can move individually
-                            , MPEGSpace      // space itself moves around in large blocks
-                            , MPEGMolecules  // molecules are divided spatially into movement blocks on the fly
-                            };
-
+        struct Group { std::vector<AtomIndex> atoms;
+                       std::vector<std::vector<AtomIndex>> sections; bool has_sections; // (for MPEGSections)
+                       Group() : has_sections( false ) {} };
+        struct KineticGroup { std::vector<uint32_t> section_start, section_of_member; // per member, the sections containing it
+                              std::vector<uint32_t> feasible_position; };        // per move, its position in feasible_moves, see below
+        struct KineticMove { uint32_t iGroup, iMove; }; // iMove is mover * 4 + direction, where mover 0 is the whole molecule, else sections[mover-1]
+        struct AffectedMover { uint32_t iGroup, iMover; uint8_t directions; // (a bit for each direction to recheck)
+                               bool operator<( const AffectedMover& other ) const { return iGroup < other.iGroup || ( iGroup == other.iGroup && iMover < other.iMover ); } };
+        struct Reaction { uint32_t chance; Neighborhood range; }; // chance out of RAND_MAX+1, 0 for no reaction
+        static const int INLINE_BONDS = MAX_BONDS < 2 ? MAX_BONDS : 2;
+        static const AtomIndex NO_GROUP = UINT32_MAX;
+        struct BondSlots { PackedBond slots[ INLINE_BONDS ]; }; // or, beyond INLINE_BONDS, slots[0] is the atom's overflow block
+        struct OverflowBonds { PackedBond slots[ MAX_BONDS ]; };
         // private variables
-        const int                         X;
-        const int                         Y;
-		std::vector<Atom>                 atoms;
-        std::vector<std::vector<Slot>>    grid;
-		std::vector<Group>                groups;
+        const Geometry                    geometry;
+        ArenaVector<Coordinate>           atom_x;          // atoms are stored as a structure of arrays
+        ArenaVector<Coordinate>           atom_y;
+        ArenaVector<Coordinate>           origin_x;        // where each atom's displacement is measured from
+        ArenaVector<Coordinate>           origin_y;
+        ArenaVector<uint8_t>              atom_type;
+        ArenaVector<uint8_t>              num_bonds;
+        ArenaVector<BondSlots,10>         bonds;           // per atom, the first num_bonds slots in use
+        ArenaVector<OverflowBonds,10>     bond_overflow;   // for atoms with more than INLINE_BONDS bonds
+        std::vector<uint32_t>             free_bond_overflow;
+        ArenaVector<uint8_t>              occupied;        // the grid is stored row by row, indexed by the geometry,
+        ArenaVector<AtomIndex>            cell_atom;       // as planes of whether each cell has an atom, and which
+        std::shared_ptr<std::vector<Group>> groups;        // shared with any forks until one of us changes them
+        ArenaVector<unsigned int>         atom_generation; // zero for removed atoms
+        ArenaVector<uint8_t>              borrowable;      // (for frozen atoms) see setBorrowable
+        std::vector<AtomIndex>            free_atoms;      // slots of removed atoms, reused by addAtom
+        ArenaVector<AtomIndex>            rigid_cluster;   // per atom, the cluster of atoms joined to it by von Neumann bonds
+        ArenaVector<AtomIndex>            atom_group;      // (see hasSingleGroups) per atom, the index of its group or NO_GROUP
+        std::vector<Group>                rigid_clusters;  // (atoms without von Neumann bonds have NO_CLUSTER)
+        std::vector<AtomIndex>            free_rigid_clusters;
+        ArenaVector<AtomIndex>            atom_molecule;   // (when the groups aren't molecules) per atom, its molecule, or
+        std::vector<Group>                molecules;       // NO_CLUSTER for atoms without bonds
+        std::vector<AtomIndex>            free_molecules;
+        std::vector<uint8_t>              is_reached;      // scratch space for splitMoleculeIfDisconnected, always left zeroed
+        std::vector<uint8_t>              is_mover;        // scratch space for moveAtomsIfPossible, always left zeroed
+        std::vector<KineticGroup>         kinetic_groups;  // (for KineticSections) per group, while kinetic_moves_valid
+        std::vector<KineticMove>          feasible_moves;  // every move currently possible
+        std::vector<AffectedMover>        affected_movers; // scratch space for updateKineticMoves
+        std::vector<AtomIndex>            kinetic_movers;  // scratch space for moveSectionsKinetically
+        bool                              kinetic_moves_valid;
+        double                            kinetic_time;
+        unsigned int                      next_generation;
+        int                               spatial_sort_interval;
+        int                               num_updates;
+        std::vector<Reaction>             reactions;       // per bond counts and type classes, see setChemistry
+        std::vector<uint16_t>             type_class;      // per atom type
+        int                               num_type_classes;
+        int                               movable_first_row;
+        int                               movable_end_row;
+        std::vector<size_t>               molecule_size_count; // see getClusterSizeCounts
+        int64_t                           squared_displacement_sum; // see getMeanSquaredDisplacement
+        size_t                            bond_range_count[ Moore2 + 1 ];
         const MovementMethod              movement_method;
         const Neighborhood                movement_neighborhood;
         const Neighborhood                chemical_neighborhood;
 
         // private functions
-        void addAllGroupsForNewBond( size_t a, size_t b );
-        void removeGroupsWithOneButNotTheOther( size_t a, size_t b );
-        void combineGroupsInvolvingTheseIntoOne( size_t a, size_t b );
+        const std::vector<Group>& getGroups() const { return *this->groups; }
+        std::vector<Group>& getWritableGroups() { if( this->groups.use_count() > 1 ) // (after a fork)
+                                                      this->groups = std::make_shared<std::vector<Group>>( *this->groups );
+                                                  return *this->groups; }
+        size_t getCell( int x, int y ) const { return this->geometry.getCellIndex( x, y ); }
+        PackedBond* getWritableBonds( AtomIndex i );
+        void checkNewBond( size_t a, size_t b, Neighborhood range ) const;
+        void addBondTo( AtomIndex a, AtomIndex b, Neighborhood range );
+        void addAllGroupsForNewBond( AtomIndex a, AtomIndex b );
+        void removeGroupsWithOneButNotTheOther( AtomIndex a, AtomIndex b );
+        void combineGroupsInvolvingTheseIntoOne( AtomIndex a, AtomIndex b );
+        void breakBondBetween( AtomIndex a, AtomIndex b );
+        Neighborhood removeBondTo( AtomIndex a, AtomIndex b );
+        void addSingletonGroupIfMobile( AtomIndex a );
+        void removeGroupsContaining( AtomIndex a );
+        void removeGroupsOfRigidlyBondedAtoms();
+        void joinRigidClusters( AtomIndex a, AtomIndex b );
+        void splitRigidCluster( AtomIndex c );
+        void rebuildMolecules();
+        void findMolecules( std::vector<Group>& molecules ) const;
+        bool hasMolecules() const;
+        bool hasSingleGroups() const;
+        void countMolecule( size_t size, int change );
+        void joinMolecules( AtomIndex a, AtomIndex b );
+        void splitMoleculeIfDisconnected( AtomIndex a, AtomIndex b );
+        void addMolecule( std::vector<AtomIndex>& atoms );
+        void regenerateAllGroupsAround( AtomIndex a, AtomIndex b );
+        void splitGroupIfDisconnected( AtomIndex a, AtomIndex b );
+        void removeGroup( size_t iGroup );
+        void removeGroupOf( AtomIndex a );
+        void indexGroups();
+        size_t floodFillGroup( const Group& group, size_t iStartMember, std::vector<bool>& reached ) const;
+        void renumberAtoms( const std::vector<AtomIndex>& new_index, size_t num_atoms );
+        unsigned int getNewGeneration();
+        void displaceAtom( AtomIndex iAtom, int dx, int dy );
         bool moveGroupIfPossible( const Group& group, int dx, int dy );
         bool moveBlockIfPossible( int x, int y, int w, int h, int dx, int dy );
+        void shiftBlock( int left, int top, int right, int bottom, int dx, int dy );
         void moveBlocksInGroup( const Group& group );
         void moveBlocksInGroup( const Group& group, int x, int y, int w, int h );
         bool moveMembersOfGroupInBlockIfPossible( const Group& group, int x, int y, int w, int h, int dx, int dy  );
+        bool moveAtomsIfPossible( std::vector<AtomIndex>& movers, int dx, int dy );
+        void moveSectionsOfGroup( size_t iGroup );
+        void computeSections( Group& group ) const;
+        void moveSectionsKinetically();
+        void buildKineticMoves();
+        void addKineticMoves( size_t iGroup );
+        void removeKineticMoves( size_t iGroup );
+        void updateKineticMoves( const std::vector<AtomIndex>& moved, int dx, int dy );
+        void updateKineticMovesAround( int x, int y );
+        void addAffectedMovers( AtomIndex iAtom, uint8_t directions, std::vector<AffectedMover>& affected ) const;
+        void recheckMovers( std::vector<AffectedMover>& affected );
+        void setMoveFeasible( uint32_t iGroup, uint32_t iMove, bool feasible );
+        bool canMoveAtoms( const std::vector<AtomIndex>& atoms, int dx, int dy );
+        bool isMovableSet( const std::vector<AtomIndex>& atoms ) const;
+        const std::vector<AtomIndex>& getMoverAtoms( uint32_t iGroup, uint32_t iMover ) const;
+        void moveEverything();
         void doChemistry();
-        bool hasBond( size_t a, size_t b ) const;
-        int getRandomMove() const;
-
-        // useful functions
-        static bool isWithinNeighborhood( Neighborhood type, int x1, int y1, int x2, int y2 );
-        static int getRandIntInclusive( int a, int b );
-        static void getRandomMove( Neighborhood nhood, int& dx, int& dy );
+        bool hasBond( AtomIndex a, AtomIndex b ) const;
+        bool hasRigidBond( AtomIndex a, AtomIndex b ) const;
+        bool isFrozen( AtomIndex a ) const { return this->atom_y[ a ] < this->movable_first_row || this->atom_y[ a ] >= this->movable_end_row; }
 };
+
+typedef ArenaT<DynamicGeometry>             Arena;      // any size
+typedef ArenaT<PowerOfTwoGeometry<10,10>>   Arena1024;  // 1024 x 1024
+typedef ArenaT<PowerOfTwoGeometry<12,12>>   Arena4096;  // 4096 x 4096
+
+#endif
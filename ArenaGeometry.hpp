@@ -0,0 +1,56 @@
+#ifndef ARENA_GEOMETRY_HPP
+#define ARENA_GEOMETRY_HPP
+
+// STL:
+#include <cstddef>
+#include <stdexcept>
+
+// The geometry of an Arena says how big it is and where each cell lives in the grid, which is stored
+// row by row. A geometry provides:
+//   getWidth(), getHeight()
+//   isOffGrid( x, y )
+//   getCellIndex( x, y )     (only for x, y on the grid)
+
+// DynamicGeometry is any size, chosen at run time
+class DynamicGeometry {
+
+    public:
+
+        DynamicGeometry( int width, int height ) : width( width ), height( height ) {}
+
+        int getWidth() const { return this->width; }
+        int getHeight() const { return this->height; }
+        bool isOffGrid( int x, int y ) const { return unsigned( x ) >= unsigned( this->width ) || unsigned( y ) >= unsigned( this->height ); }
+        size_t getCellIndex( int x, int y ) const { return size_t( y ) * this->width + x; }
+
+    private:
+
+        const int width;
+        const int height;
+};
+
+// PowerOfTwoGeometry is a size fixed at compile time, 2^LOG2_WIDTH by 2^LOG2_HEIGHT, so that indexing
+// is a shift and an or, and the bounds checks compare against constants
+template<int LOG2_WIDTH, int LOG2_HEIGHT>
+class PowerOfTwoGeometry {
+
+    public:
+
+        static const int WIDTH = 1 << LOG2_WIDTH;
+        static const int HEIGHT = 1 << LOG2_HEIGHT;
+
+        PowerOfTwoGeometry( int width, int height ) {
+            if( width != WIDTH || height != HEIGHT )
+                throw std::invalid_argument("Arena size does not match its geometry");
+        }
+
+        static int getWidth() { return WIDTH; }
+        static int getHeight() { return HEIGHT; }
+        static bool isOffGrid( int x, int y ) { return ( ( unsigned( x ) >> LOG2_WIDTH ) | ( unsigned( y ) >> LOG2_HEIGHT ) ) != 0; }
+        static size_t getCellIndex( int x, int y ) { return ( size_t( y ) << LOG2_WIDTH ) | size_t( x ); }
+};
+
+template<int LOG2_WIDTH, int LOG2_HEIGHT> const int PowerOfTwoGeometry<LOG2_WIDTH,LOG2_HEIGHT>::WIDTH;
+template<int LOG2_WIDTH, int LOG2_HEIGHT> const int PowerOfTwoGeometry<LOG2_WIDTH,LOG2_HEIGHT>::HEIGHT;
+
+#endif
@@ -0,0 +1,140 @@
+// local:
+#include "Chemistry.hpp"
+
+// stdlib:
+#include <stdlib.h>
+
+// STL:
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <limits>
+using namespace std;
+
+const int Chemistry::ANY;
+const int Chemistry::SAME;
+
+//----------------------------------------------------------------------------
+
+void Chemistry::readText( istream& in ) {
+    string line;
+    int iLine = 0;
+    while( getline( in, line ) ) {
+        iLine++;
+        const size_t iComment = line.find( '#' );
+        if( iComment != string::npos )
+            line.erase( iComment );
+        istringstream words( line );
+        string keyword;
+        if( !( words >> keyword ) )
+            continue; // blank line
+        if( keyword != "rule" ) {
+            ostringstream error;
+            error << "Chemistry line " << iLine << ": unknown entry '" << keyword << "'";
+            throw runtime_error( error.str() );
+        }
+        string type_a, type_b, bonds_a, bonds_b, range;
+        if( !( words >> type_a >> type_b >> bonds_a >> bonds_b >> range ) ) {
+            ostringstream error;
+            error << "Chemistry line " << iLine << ": malformed rule";
+            throw runtime_error( error.str() );
+        }
+        Rule rule;
+        rule.type_a = readValue( type_a, numeric_limits<uint8_t>::max(), false );
+        rule.type_b = readValue( type_b, numeric_limits<uint8_t>::max(), true );
+        rule.bonds_a = readValue( bonds_a, Arena::MAX_BONDS - 1, false );
+        rule.bonds_b = readValue( bonds_b, Arena::MAX_BONDS - 1, false );
+        rule.range = Arena::getNeighborhood( range );
+        rule.probability = 1.0;
+        string probability;
+        if( words >> probability ) {
+            char *end;
+            rule.probability = strtod( probability.c_str(), &end );
+            if( end == probability.c_str() || *end != '\0' ) {
+                ostringstream error;
+                error << "Chemistry line " << iLine << ": expected a probability but found '" << probability << "'";
+                throw runtime_error( error.str() );
+            }
+            if( !( rule.probability > 0.0 && rule.probability <= 1.0 ) ) { // (which also catches nan)
+                ostringstream error;
+                error << "Chemistry line " << iLine << ": probability must be in (0,1]";
+                throw runtime_error( error.str() );
+            }
+        }
+        string extra;
+        if( words >> extra ) {
+            ostringstream error;
+            error << "Chemistry line " << iLine << ": unexpected '" << extra << "' after rule";
+            throw runtime_error( error.str() );
+        }
+        this->rules.push_back( rule );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void Chemistry::writeText( ostream& out ) const {
+    for( const Rule& rule : this->rules ) {
+        out << "rule";
+        writeValue( out, rule.type_a );
+        writeValue( out, rule.type_b );
+        writeValue( out, rule.bonds_a );
+        writeValue( out, rule.bonds_b );
+        out << " " << Arena::getNeighborhoodName( rule.range );
+        if( rule.probability < 1.0 )
+            out << " " << rule.probability;
+        out << "\n";
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void Chemistry::load( const string& filename ) {
+    ifstream in( filename.c_str() );
+    if( !in )
+        throw runtime_error("Could not open chemistry file: " + filename);
+    readText( in );
+}
+
+//----------------------------------------------------------------------------
+
+Chemistry Chemistry::getDefault() {
+    // (the other way around is implied)
+    const Rule none_and_none = { ANY, SAME, 0, 0, Arena::Moore, 1.0 };
+    const Rule none_and_one  = { ANY, SAME, 0, 1, Arena::Moore, 1.0 };
+    Chemistry chemistry;
+    chemistry.rules.push_back( none_and_none );
+    chemistry.rules.push_back( none_and_one );
+    return chemistry;
+}
+
+//----------------------------------------------------------------------------
+
+int Chemistry::readValue( const string& word, int max_value, bool allow_same ) {
+    if( word == "*" )
+        return ANY;
+    if( word == "=" ) {
+        if( !allow_same )
+            throw runtime_error("Only the second type of a rule can be =");
+        return SAME;
+    }
+    char *end;
+    const long value = strtol( word.c_str(), &end, 10 );
+    if( end == word.c_str() || *end != '\0' )
+        throw runtime_error("Expected a number or * in rule: " + word);
+    if( value < 0 || value > max_value )
+        throw out_of_range("Value out of range in rule: " + word);
+    return int( value );
+}
+
+//----------------------------------------------------------------------------
+
+void Chemistry::writeValue( ostream& out, int value ) {
+    switch( value ) {
+        case ANY:  out << " *"; break;
+        case SAME: out << " ="; break;
+        default:   out << " " << value; break;
+    }
+}
+
+//----------------------------------------------------------------------------
@@ -0,0 +1,41 @@
+#ifndef CHEMISTRY_HPP
+#define CHEMISTRY_HPP
+
+// local:
+#include "Arena.hpp"
+
+// STL:
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+// Chemistry is the set of rules saying which neighboring atoms can bond, given to Arena::setChemistry
+//
+// The text format has one rule per line, with # starting a comment:
+//   rule <typeA> <typeB> <bondsA> <bondsB> <range> [<probability>]
+// A type or bond count of * matches anything, and a typeB of = matches the same type as A. Rules apply
+// either way around, and where several rules match the first one given wins.
+class Chemistry {
+
+    public:
+
+        static const int ANY = -1;
+        static const int SAME = -2;   // (for type_b only)
+
+        struct Rule { int type_a, type_b; int bonds_a, bonds_b; Arena::Neighborhood range; double probability; };
+
+        std::vector<Rule> rules;
+
+        void readText( std::istream& in );
+        void writeText( std::ostream& out ) const;
+        void load( const std::string& filename );
+
+        static Chemistry getDefault(); // atoms of the same type bond if they have fewer than two bonds between them
+
+    private:
+
+        static int readValue( const std::string& word, int max_value, bool allow_same );
+        static void writeValue( std::ostream& out, int value );
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef COPY_ON_WRITE_VECTOR_HPP
+#define COPY_ON_WRITE_VECTOR_HPP
+
+// STL:
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// CopyOnWriteVector is an array stored in chunks that copies of it share until one of them writes
+//
+// Copying the vector only copies the list of chunks. Each vector remembers which of its chunks it has
+// written since the last copy, and the first write to any other chunk gives the vector its own copy of
+// that chunk, so two copies of a large vector only cost memory for the chunks where they differ.
+//
+// Reading through operator[] never copies, but writing does, so non-const operator[] returns a
+// Reference that only claims the chunk when it is assigned to. Copying a vector is not thread-safe,
+// even though it is const, since it changes the chunk ownership of the original too.
+template<class T, int LOG2_CHUNK_SIZE = 12>
+class CopyOnWriteVector {
+
+    public:
+
+        static const size_t CHUNK_SIZE = size_t( 1 ) << LOG2_CHUNK_SIZE;
+
+        // a writable element, as returned by non-const operator[]
+        class Reference {
+            public:
+                Reference( CopyOnWriteVector& v, size_t i ) : v( v ), i( i ) {}
+                operator const T&() const { return v.get( i ); }
+                Reference& operator=( const T& value ) { v.getWritable( i ) = value; return *this; }
+                Reference& operator=( const Reference& other ) { return *this = T( other ); }
+                Reference& operator+=( const T& value ) { v.getWritable( i ) += value; return *this; }
+                Reference& operator-=( const T& value ) { v.getWritable( i ) -= value; return *this; }
+                T operator++() { return ++v.getWritable( i ); }
+                T operator--() { return --v.getWritable( i ); }
+                T operator++( int ) { return v.getWritable( i )++; }
+                T operator--( int ) { return v.getWritable( i )--; }
+            private:
+                CopyOnWriteVector& v;
+                const size_t i;
+        };
+
+        CopyOnWriteVector() : num_elements( 0 ) {}
+        explicit CopyOnWriteVector( size_t n, const T& value = T() ) : num_elements( 0 ) { resize( n, value ); }
+        CopyOnWriteVector( const CopyOnWriteVector& other ) { *this = other; }
+        CopyOnWriteVector& operator=( const CopyOnWriteVector& other );
+
+        size_t size() const { return this->num_elements; }
+        const T& operator[]( size_t i ) const { return get( i ); }
+        Reference operator[]( size_t i ) { return Reference( *this, i ); }
+        const T& get( size_t i ) const { return this->data[ i >> LOG2_CHUNK_SIZE ][ i & ( CHUNK_SIZE - 1 ) ]; }
+        T& getWritable( size_t i );
+
+        void push_back( const T& value );
+        void resize( size_t n, const T& value = T() );
+        void assign( size_t n, const T& value );
+        void swap( CopyOnWriteVector& other );
+        void moveSpan( size_t target, size_t source, size_t n ); // as memmove, the spans may overlap
+        void fillSpan( size_t first, size_t n, const T& value );
+
+    private:
+
+        std::vector<std::shared_ptr<std::vector<T>>> chunks;
+        std::vector<T*>                               data;  // the start of each chunk
+        mutable std::vector<uint8_t>                  owned; // whether each chunk has been written since the last copy
+        size_t                                        num_elements;
+
+        void makeOwned( size_t iChunk );
+};
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+CopyOnWriteVector<T,LOG2_CHUNK_SIZE>& CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::operator=( const CopyOnWriteVector& other ) {
+    if( this == &other )
+        return *this;
+    this->chunks = other.chunks;
+    this->data = other.data;
+    this->num_elements = other.num_elements;
+    // neither of us can write to the chunks in place any more
+    other.owned.assign( other.chunks.size(), 0 );
+    this->owned = other.owned;
+    return *this;
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+T& CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::getWritable( size_t i ) {
+    const size_t iChunk = i >> LOG2_CHUNK_SIZE;
+    if( !this->owned[ iChunk ] )
+        makeOwned( iChunk );
+    return this->data[ iChunk ][ i & ( CHUNK_SIZE - 1 ) ];
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::makeOwned( size_t iChunk ) {
+    // (if the other copies have all gone then the chunk is already ours alone)
+    if( this->chunks[ iChunk ].use_count() > 1 ) {
+        this->chunks[ iChunk ] = std::make_shared<std::vector<T>>( *this->chunks[ iChunk ] );
+        this->data[ iChunk ] = this->chunks[ iChunk ]->data();
+    }
+    this->owned[ iChunk ] = 1;
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::push_back( const T& value ) {
+    if( this->num_elements == this->chunks.size() * CHUNK_SIZE ) {
+        this->chunks.push_back( std::make_shared<std::vector<T>>( CHUNK_SIZE ) );
+        this->data.push_back( this->chunks.back()->data() );
+        this->owned.push_back( 1 );
+    }
+    getWritable( this->num_elements++ ) = value;
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::resize( size_t n, const T& value ) {
+    const size_t num_chunks = ( n + CHUNK_SIZE - 1 ) >> LOG2_CHUNK_SIZE;
+    const size_t old_size = this->num_elements;
+    // any new elements in the last chunk we already have
+    if( n > old_size )
+        fillSpan( old_size, std::min( n, this->chunks.size() * CHUNK_SIZE ) - old_size, value );
+    // whole new chunks are ours alone from the start
+    while( this->chunks.size() < num_chunks ) {
+        this->chunks.push_back( std::make_shared<std::vector<T>>( CHUNK_SIZE, value ) );
+        this->data.push_back( this->chunks.back()->data() );
+        this->owned.push_back( 1 );
+    }
+    this->chunks.resize( num_chunks );
+    this->data.resize( num_chunks );
+    this->owned.resize( num_chunks );
+    this->num_elements = n;
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::assign( size_t n, const T& value ) {
+    this->chunks.clear();
+    this->data.clear();
+    this->owned.clear();
+    this->num_elements = 0;
+    resize( n, value );
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::swap( CopyOnWriteVector& other ) {
+    this->chunks.swap( other.chunks );
+    this->data.swap( other.data );
+    this->owned.swap( other.owned );
+    std::swap( this->num_elements, other.num_elements );
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::moveSpan( size_t target, size_t source, size_t n ) {
+    // in pieces that lie within one chunk at each end, working away from the overlap
+    if( target < source ) {
+        for( size_t i = 0; i < n; ) {
+            const size_t len = std::min( n - i, std::min( CHUNK_SIZE - ( ( source + i ) & ( CHUNK_SIZE - 1 ) ),
+                                                          CHUNK_SIZE - ( ( target + i ) & ( CHUNK_SIZE - 1 ) ) ) );
+            T* to = &getWritable( target + i ); // (first, in case it copies the chunk we read from)
+            const T* from = &get( source + i );
+            std::copy( from, from + len, to );
+            i += len;
+        }
+    }
+    else if( target > source ) {
+        for( size_t i = n; i > 0; ) {
+            const size_t len = std::min( i, std::min( ( ( source + i - 1 ) & ( CHUNK_SIZE - 1 ) ) + 1,
+                                                      ( ( target + i - 1 ) & ( CHUNK_SIZE - 1 ) ) + 1 ) );
+            i -= len;
+            T* to = &getWritable( target + i );
+            const T* from = &get( source + i );
+            std::copy_backward( from, from + len, to + len );
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE>
+void CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::fillSpan( size_t first, size_t n, const T& value ) {
+    for( size_t i = 0; i < n; ) {
+        const size_t len = std::min( n - i, CHUNK_SIZE - ( ( first + i ) & ( CHUNK_SIZE - 1 ) ) );
+        T* to = &getWritable( first + i );
+        std::fill( to, to + len, value );
+        i += len;
+    }
+}
+
+//----------------------------------------------------------------------------
+
+template<class T, int LOG2_CHUNK_SIZE> const size_t CopyOnWriteVector<T,LOG2_CHUNK_SIZE>::CHUNK_SIZE;
+
+// ContiguousVector is a std::vector with the interface of CopyOnWriteVector, for when copies needn't share
+template<class T>
+class ContiguousVector : public std::vector<T> {
+
+    public:
+
+        ContiguousVector() {}
+        explicit ContiguousVector( size_t n, const T& value = T() ) : std::vector<T>( n, value ) {}
+
+        const T& get( size_t i ) const { return (*this)[ i ]; }
+        T& getWritable( size_t i ) { return (*this)[ i ]; }
+        void moveSpan( size_t target, size_t source, size_t n ) {
+            if( target < source )
+                std::copy( this->begin() + source, this->begin() + source + n, this->begin() + target );
+            else
+                std::copy_backward( this->begin() + source, this->begin() + source + n, this->begin() + target + n );
+        }
+        void fillSpan( size_t first, size_t n, const T& value ) { std::fill_n( this->begin() + first, n, value ); }
+};
+
+#endif
@@ -0,0 +1,293 @@
+// local:
+#include "DomainStrip.hpp"
+#include "Trace.hpp"
+
+// stdlib:
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// STL:
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+
+const int DomainStrip::HALO;
+
+//----------------------------------------------------------------------------
+
+DomainStrip::DomainStrip( Transport& transport, int width, int height, Arena::MovementMethod method )
+    : transport( transport )
+    , width( width )
+    , height( height )
+    , first_row( getFirstRowOf( transport.getRank(), transport.getNumberOfRanks(), height ) )
+    , end_row( getFirstRowOf( transport.getRank() + 1, transport.getNumberOfRanks(), height ) )
+    , arena_top( max( 0, first_row - HALO ) )
+    , arena( width, min( height, end_row + HALO ) - arena_top, method )
+{
+    // (the strips on either side of a waiting one must not see each other's changes)
+    if( transport.getNumberOfRanks() > 1 && height / transport.getNumberOfRanks() < 2 * HALO )
+        throw invalid_argument("Too many processes for the height of the world");
+    this->arena.setMovableRows( this->first_row - this->arena_top, this->end_row - this->arena_top );
+}
+
+//----------------------------------------------------------------------------
+
+int DomainStrip::getFirstRowOf( int rank, int num_ranks, int height ) {
+    return int( int64_t( height ) * rank / num_ranks );
+}
+
+//----------------------------------------------------------------------------
+
+void DomainStrip::load( const Scene& scene ) {
+    // the atoms within the arena, including the ghosts, and the bonds between them
+    for( const Arena::BondSpec& bond : scene.bonds ) {
+        if( bond.a >= scene.atoms.size() || bond.b >= scene.atoms.size() )
+            throw out_of_range("Scene bond refers to a missing atom");
+    }
+    vector<Arena::AtomSpec> atoms;
+    vector<size_t> local_index( scene.atoms.size(), SIZE_MAX );
+    for( size_t i = 0; i < scene.atoms.size(); ++i ) {
+        Arena::AtomSpec atom = scene.atoms[ i ];
+        atom.y -= this->arena_top;
+        if( this->arena.isOffGrid( atom.x, atom.y ) )
+            continue;
+        local_index[ i ] = atoms.size();
+        atoms.push_back( atom );
+    }
+    const size_t first = this->arena.addAtoms( atoms );
+    vector<Arena::BondSpec> bonds;
+    for( const Arena::BondSpec& bond : scene.bonds ) {
+        if( local_index[ bond.a ] == SIZE_MAX || local_index[ bond.b ] == SIZE_MAX )
+            continue;
+        const Arena::BondSpec local_bond = { first + local_index[ bond.a ], first + local_index[ bond.b ], bond.range };
+        bonds.push_back( local_bond );
+    }
+    try {
+        this->arena.addBonds( bonds );
+    }
+    catch( ... ) {
+        // addBonds has undone its own bonds, so removing our atoms leaves the strip as it was
+        for( size_t i = 0; i < atoms.size(); ++i )
+            this->arena.removeAtom( this->arena.getHandle( first + i ) );
+        throw;
+    }
+
+    // the random fills only go in our own rows, in proportion to their share of the world
+    for( const Scene::Fill& fill : scene.fills ) {
+        if( fill.max_type < fill.min_type )
+            throw invalid_argument("Scene fill has an empty range of types");
+        const int num_tries = int( int64_t( fill.num_tries ) * ( this->end_row - this->first_row ) / this->height );
+        for( int iTry = 0; iTry < num_tries; ++iTry ) {
+            Arena::AtomSpec atom;
+            atom.x = rand() % this->width;
+            atom.y = this->first_row - this->arena_top + rand() % ( this->end_row - this->first_row );
+            atom.type = fill.min_type + rand() % ( fill.max_type - fill.min_type + 1 );
+            if( !this->arena.hasAtom( atom.x, atom.y ) )
+                this->arena.addAtom( atom.x, atom.y, atom.type );
+        }
+    }
+
+    // then let the neighbours see them
+    exchange( 0 );
+    exchange( 1 );
+}
+
+//----------------------------------------------------------------------------
+
+void DomainStrip::update() {
+    for( int phase = 0; phase < 2; ++phase ) {
+        if( this->transport.getRank() % 2 == phase )
+            this->arena.update();
+        exchange( phase );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void DomainStrip::exchange( int phase ) {
+    // the strips that have just had their turn tell their waiting neighbours what changed
+    TRACE_SCOPE("exchange");
+    const int rank = this->transport.getRank();
+    for( int neighbour = rank - 1; neighbour <= rank + 1; neighbour += 2 ) {
+        if( neighbour < 0 || neighbour >= this->transport.getNumberOfRanks() )
+            continue;
+        if( rank % 2 == phase )
+            sendBand( neighbour );
+        else
+            receiveBand( neighbour );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+int DomainStrip::getBoundary( int neighbour ) const {
+    return neighbour < this->transport.getRank() ? this->first_row : this->end_row;
+}
+
+//----------------------------------------------------------------------------
+
+void DomainStrip::sendBand( int neighbour ) {
+    // The band is the HALO rows either side of the boundary: our atoms that are the neighbour's ghosts,
+    // and our ghosts of the neighbour's atoms, including any that have just moved across or that we have
+    // moved on the neighbour's behalf. The message holds the atoms as (x,y,type,number of bonds) and then
+    // the bonds between them as (a,b,range), in world coordinates.
+    const int boundary = getBoundary( neighbour );
+    vector<int32_t> values( 1, 0 );
+    vector<size_t> members;
+    for( int y = boundary - HALO; y < boundary + HALO; ++y ) {
+        for( int x = 0; x < this->width; ++x ) {
+            if( !this->arena.hasAtom( x, y - this->arena_top ) )
+                continue;
+            const size_t iAtom = this->arena.getAtomAt( x, y - this->arena_top );
+            members.push_back( iAtom );
+            values.push_back( x );
+            values.push_back( y );
+            values.push_back( this->arena.getAtomType( iAtom ) );
+            values.push_back( int32_t( this->arena.getBonds( Arena::AtomIndex( iAtom ) ).size() ) );
+        }
+    }
+    values[ 0 ] = int32_t( members.size() );
+    // (atom index, member index) pairs, sorted for lookup
+    vector<pair<size_t,size_t>> member_of;
+    for( size_t iMember = 0; iMember < members.size(); ++iMember )
+        member_of.push_back( make_pair( members[ iMember ], iMember ) );
+    sort( member_of.begin(), member_of.end() );
+    const size_t iCount = values.size();
+    values.push_back( 0 );
+    for( size_t iMember = 0; iMember < members.size(); ++iMember ) {
+        for( const Arena::Bond& bond : this->arena.getBonds( Arena::AtomIndex( members[ iMember ] ) ) ) {
+            const auto& it = lower_bound( member_of.begin(), member_of.end(), make_pair( size_t( bond.iAtom ), size_t( 0 ) ) );
+            if( it == member_of.end() || it->first != bond.iAtom )
+                continue; // outside the band
+            const size_t iOther = it->second;
+            if( iOther < iMember )
+                continue; // (each bond once)
+            values.push_back( int32_t( iMember ) );
+            values.push_back( int32_t( iOther ) );
+            values.push_back( bond.range );
+            values[ iCount ]++;
+        }
+    }
+    vector<char> message( values.size() * sizeof( int32_t ) );
+    memcpy( message.data(), values.data(), message.size() );
+    this->transport.send( neighbour, message );
+}
+
+//----------------------------------------------------------------------------
+
+void DomainStrip::receiveBand( int neighbour ) {
+    vector<char> message;
+    this->transport.receive( neighbour, message );
+    vector<int32_t> values( message.size() / sizeof( int32_t ) );
+    memcpy( values.data(), message.data(), values.size() * sizeof( int32_t ) );
+    const int32_t* value = values.data();
+    const int32_t* end = value + values.size();
+    if( value == end )
+        throw runtime_error("Malformed band message");
+    const int32_t num_atoms = *value++;
+    if( num_atoms < 0 || end - value < 4 * int64_t( num_atoms ) + 1 )
+        throw runtime_error("Malformed band message");
+    const int32_t* atom_values = value;
+    value += 4 * num_atoms;
+    const int32_t num_bonds = *value++;
+    if( num_bonds < 0 || end - value != 3 * int64_t( num_bonds ) )
+        throw runtime_error("Malformed band message");
+
+    // the atoms of the message, by their position in the band
+    const int boundary = getBoundary( neighbour );
+    const int band_top = boundary - HALO;
+    vector<int32_t> member_at( size_t( 2 * HALO ) * this->width, -1 );
+    for( int32_t i = 0; i < num_atoms; ++i ) {
+        const int x = atom_values[ 4 * i ];
+        const int y = atom_values[ 4 * i + 1 ];
+        if( x < 0 || x >= this->width || y < band_top || y >= boundary + HALO || this->arena.isOffGrid( x, y - this->arena_top ) )
+            throw runtime_error("Band atom outside the arena");
+        int32_t& member = member_at[ size_t( y - band_top ) * this->width + x ];
+        if( member >= 0 )
+            throw runtime_error("Malformed band message");
+        member = i;
+    }
+
+    // The neighbour's view of the whole band is the latest, since we have been waiting: as well as its own
+    // atoms it has any of ours that it moved along with its own (see Arena::isMovableSet). So out with
+    // the atoms that have gone or changed, leaving the rest (and their molecules) alone.
+    for( int y = band_top; y < boundary + HALO; ++y ) {
+        for( int x = 0; x < this->width; ++x ) {
+            if( !this->arena.hasAtom( x, y - this->arena_top ) )
+                continue;
+            const size_t iAtom = this->arena.getAtomAt( x, y - this->arena_top );
+            const int32_t iMember = member_at[ size_t( y - band_top ) * this->width + x ];
+            if( iMember < 0 || atom_values[ 4 * iMember + 2 ] != this->arena.getAtomType( iAtom ) )
+                this->arena.removeAtom( this->arena.getHandle( iAtom ) );
+        }
+    }
+    // in with the new ones, and any atoms that have moved
+    vector<size_t> local_index( num_atoms );
+    for( int32_t i = 0; i < num_atoms; ++i ) {
+        const int x = atom_values[ 4 * i ];
+        const int y = atom_values[ 4 * i + 1 ] - this->arena_top;
+        if( !this->arena.hasAtom( x, y ) )
+            local_index[ i ] = this->arena.addAtom( x, y, atom_values[ 4 * i + 2 ] );
+        else
+            local_index[ i ] = this->arena.getAtomAt( x, y );
+    }
+
+    // the message has every bond between atoms of the band, so any others between them have been broken
+    vector<Arena::BondSpec> bonds;
+    vector<pair<size_t,size_t>> bond_between; // (sorted, for lookup)
+    for( int32_t i = 0; i < num_bonds; ++i, value += 3 ) {
+        if( value[0] < 0 || value[0] >= num_atoms || value[1] < 0 || value[1] >= num_atoms ||
+                value[2] < Arena::vonNeumann || value[2] > Arena::Moore2 )
+            throw runtime_error("Malformed band message");
+        const Arena::BondSpec bond = { local_index[ value[0] ], local_index[ value[1] ], Arena::Neighborhood( value[2] ) };
+        bonds.push_back( bond );
+        bond_between.push_back( make_pair( min( bond.a, bond.b ), max( bond.a, bond.b ) ) );
+    }
+    sort( bond_between.begin(), bond_between.end() );
+    for( int32_t i = 0; i < num_atoms; ++i ) {
+        const size_t iAtom = local_index[ i ];
+        vector<size_t> broken;
+        for( const Arena::Bond& bond : this->arena.getBonds( Arena::AtomIndex( iAtom ) ) ) {
+            const int y = this->arena.getAtomY( bond.iAtom ) + this->arena_top;
+            if( y < band_top || y >= boundary + HALO )
+                continue; // (a bond of one of our atoms that the neighbour can't see)
+            if( !binary_search( bond_between.begin(), bond_between.end(), make_pair( min( iAtom, size_t( bond.iAtom ) ), max( iAtom, size_t( bond.iAtom ) ) ) ) )
+                broken.push_back( bond.iAtom );
+        }
+        for( const size_t& iOther : broken )
+            this->arena.breakBond( this->arena.getHandle( iAtom ), this->arena.getHandle( iOther ) );
+    }
+    // and any bonds we don't know about yet are made
+    for( const Arena::BondSpec& bond : bonds ) {
+        bool known = false;
+        for( const Arena::Bond& existing : this->arena.getBonds( Arena::AtomIndex( bond.a ) ) )
+            known = known || existing.iAtom == bond.b;
+        if( !known )
+            this->arena.makeBond( bond.a, bond.b, bond.range );
+    }
+
+    // we can move the ghosts whose bonds we can all see along with our own atoms, if we hold the topmost
+    for( int32_t i = 0; i < num_atoms; ++i ) {
+        const int y = atom_values[ 4 * i + 1 ];
+        if( y >= this->first_row && y < this->end_row )
+            continue; // one of ours
+        const size_t num_bonds = this->arena.getBonds( Arena::AtomIndex( local_index[ i ] ) ).size();
+        this->arena.setBorrowable( local_index[ i ], num_bonds == size_t( atom_values[ 4 * i + 3 ] ) );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+size_t DomainStrip::getNumberOfOwnedAtoms() const {
+    size_t n = 0;
+    for( int y = this->first_row; y < this->end_row; ++y ) {
+        for( int x = 0; x < this->width; ++x ) {
+            if( this->arena.hasAtom( x, y - this->arena_top ) )
+                n++;
+        }
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------------
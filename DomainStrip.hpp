@@ -0,0 +1,60 @@
+#ifndef DOMAIN_STRIP_HPP
+#define DOMAIN_STRIP_HPP
+
+// local:
+#include "Arena.hpp"
+#include "Scene.hpp"
+#include "Transport.hpp"
+
+// STL:
+#include <vector>
+
+// DomainStrip is one process's share of a world split into horizontal strips, one per process
+//
+// Each process keeps its strip in an Arena, with HALO rows on either side holding ghost copies of its
+// neighbours' atoms. Atoms in the strip itself can move, and so can ghosts whose bonds are all within the
+// arena, but only along with a set of atoms whose topmost is in the strip (see Arena::isMovableSet). So a
+// molecule or rigid cluster straddling a boundary is moved as a whole by the strip above, while one that
+// reaches further than HALO rows into the strip below can only move in parts that don't straddle it.
+// Neighbours take turns: the even ranks update while the odd ranks wait, and then the other way around,
+// so the ghosts are always up to date while a strip moves. At the end of each turn the rows near the
+// boundary are sent to the waiting neighbours, handing over any atoms that moved across and any bonds
+// made across the boundary, and refreshing the ghosts.
+class DomainStrip {
+
+    public:
+
+        // bonds span at most two rows, plus one so that the ghosts next to the strip have all their bonds
+        static const int HALO = 3;
+
+        DomainStrip( Transport& transport, int width, int height, Arena::MovementMethod method = Arena::MPEGMolecules );
+
+        void load( const Scene& scene ); // every process loads the same scene, keeping only its own part
+        void update();                   // every process must call this together
+
+        // accessors
+        int getFirstRow() const { return this->first_row; }
+        int getEndRow() const { return this->end_row; }
+        int getArenaTop() const { return this->arena_top; } // the row of the world at the top of the arena
+        const Arena& getArena() const { return this->arena; }
+        size_t getNumberOfOwnedAtoms() const;
+
+    private:
+
+        Transport&  transport;
+        const int   width;
+        const int   height;
+        const int   first_row;  // the rows of the world that we own
+        const int   end_row;
+        const int   arena_top;
+        Arena       arena;
+
+        void exchange( int phase );
+        void sendBand( int neighbour );
+        void receiveBand( int neighbour );
+        int getBoundary( int neighbour ) const;
+
+        static int getFirstRowOf( int rank, int num_ranks, int height );
+};
+
+#endif
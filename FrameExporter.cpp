@@ -0,0 +1,207 @@
+// local:
+#include "FrameExporter.hpp"
+#include "Trace.hpp"
+
+// stdlib:
+#include <stdio.h>
+#include <stdlib.h>
+
+// STL:
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+using namespace std;
+
+// the colours of MyFrame::drawArena
+static const uint8_t WHITE[3]       = { 255, 255, 255 };
+static const uint8_t BLACK[3]       = {   0,   0,   0 };
+static const uint8_t MEDIUM_GREY[3] = { 128, 128, 128 };
+static const uint8_t ATOM_COLORS[6][3] = { { 255,   0,   0 }    // red
+                                         , { 255, 255,   0 }    // yellow
+                                         , {   0, 255, 255 }    // cyan
+                                         , { 192, 192, 192 }    // light grey
+                                         , {   0,   0, 255 }    // blue
+                                         , {   0, 255,   0 } }; // green
+
+//----------------------------------------------------------------------------
+
+FrameExporter::FrameExporter( const string& prefix, int scale, int num_threads )
+    : prefix( prefix )
+    , scale( scale )
+    , max_queued( 0 )
+    , num_frames( 0 )
+    , num_busy( 0 )
+    , stopping( false )
+{
+    if( scale < 1 )
+        throw out_of_range("Scale must be at least 1");
+    if( num_threads <= 0 )
+        num_threads = max( 1, int( thread::hardware_concurrency() ) );
+    // enough to keep every thread busy while the next frames are simulated
+    this->max_queued = 4 * size_t( num_threads );
+    for( int i = 0; i < num_threads; ++i )
+        this->threads.push_back( thread( &FrameExporter::runThread, this ) );
+}
+
+//----------------------------------------------------------------------------
+
+FrameExporter::~FrameExporter() {
+    {
+        unique_lock<mutex> lock( this->queue_mutex );
+        this->stopping = true;
+    }
+    this->work_available.notify_all();
+    for( thread& t : this->threads )
+        t.join();
+}
+
+//----------------------------------------------------------------------------
+
+void FrameExporter::addFrame( const Arena& arena ) {
+    TRACE_SCOPE("addFrame");
+    // take the snapshot before locking, so the threads can carry on meanwhile
+    Snapshot snapshot;
+    snapshot.width = arena.getArenaWidth();
+    snapshot.height = arena.getArenaHeight();
+    snapshot.atoms.reserve( arena.getNumberOfLiveAtoms() );
+    for( size_t iAtom = 0; iAtom < arena.getNumberOfAtoms(); ++iAtom ) {
+        if( !arena.isLiveAtom( iAtom ) ) continue;
+        const int x = arena.getAtomX( iAtom );
+        const int y = arena.getAtomY( iAtom );
+        const Arena::AtomSpec spec = { x, y, arena.getAtomType( iAtom ) };
+        snapshot.atoms.push_back( spec );
+        for( const Arena::Bond& bond : arena.getBonds( Arena::AtomIndex( iAtom ) ) ) {
+            if( bond.iAtom < iAtom ) continue; // (each bond once)
+            const BondLine line = { x, y, arena.getAtomX( bond.iAtom ), arena.getAtomY( bond.iAtom ), bond.range };
+            snapshot.bonds.push_back( line );
+        }
+    }
+
+    unique_lock<mutex> lock( this->queue_mutex );
+    while( this->queue.size() >= this->max_queued )
+        this->work_done.wait( lock );
+    snapshot.iFrame = this->num_frames++;
+    this->queue.push_back( move( snapshot ) );
+    lock.unlock();
+    this->work_available.notify_one();
+}
+
+//----------------------------------------------------------------------------
+
+void FrameExporter::finish() {
+    unique_lock<mutex> lock( this->queue_mutex );
+    while( !this->queue.empty() || this->num_busy > 0 )
+        this->work_done.wait( lock );
+    if( !this->error.empty() ) {
+        const string message = this->error;
+        this->error.clear();
+        throw runtime_error( message );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void FrameExporter::runThread() {
+    unique_lock<mutex> lock( this->queue_mutex );
+    while( true ) {
+        while( this->queue.empty() && !this->stopping )
+            this->work_available.wait( lock );
+        if( this->queue.empty() )
+            return; // stopping, with nothing left to write
+        const Snapshot snapshot( move( this->queue.front() ) );
+        this->queue.pop_front();
+        this->num_busy++;
+        lock.unlock();
+        string failure;
+        try {
+            writeFrame( snapshot );
+        }
+        catch( exception& e ) {
+            failure = e.what();
+        }
+        lock.lock();
+        if( !failure.empty() && this->error.empty() )
+            this->error = failure;
+        this->num_busy--;
+        this->work_done.notify_all();
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void FrameExporter::writeFrame( const Snapshot& snapshot ) const {
+    TRACE_SCOPE("writeFrame");
+    // the arena with its border, as drawn by MyFrame::draw
+    const int s = this->scale;
+    const int w = snapshot.width * s + 1;
+    const int h = snapshot.height * s + 1;
+    vector<uint8_t> pixels( size_t( w ) * h * 3 );
+    fillRect( pixels, w, h, 0, 0, w, h, BLACK );
+    fillRect( pixels, w, h, 1, 1, w - 2, h - 2, WHITE );
+
+    // atoms
+    for( const Arena::AtomSpec& atom : snapshot.atoms ) {
+        const int iColor = ( atom.type >= 0 && atom.type < 6 ) ? atom.type : 0;
+        fillRect( pixels, w, h, atom.x * s, atom.y * s, s + 1, s + 1, MEDIUM_GREY );
+        fillRect( pixels, w, h, atom.x * s + 1, atom.y * s + 1, s - 1, s - 1, ATOM_COLORS[ iColor ] );
+    }
+
+    // bonds
+    for( const BondLine& bond : snapshot.bonds ) {
+        int thickness = 1;
+        const uint8_t* color = BLACK;
+        switch( bond.range ) {
+            default:
+            case Arena::Neighborhood::Moore:       break;
+            case Arena::Neighborhood::vonNeumann:  thickness = 2; break;
+            case Arena::Neighborhood::vonNeumann2:
+            case Arena::Neighborhood::Moore2:      color = MEDIUM_GREY; break;
+        }
+        drawLine( pixels, w, h, bond.x1 * s + s / 2, bond.y1 * s + s / 2, bond.x2 * s + s / 2, bond.y2 * s + s / 2, thickness, color );
+    }
+
+    char filename[32];
+    snprintf( filename, sizeof( filename ), "%06d.ppm", snapshot.iFrame );
+    const string path = this->prefix + filename;
+    FILE *f = fopen( path.c_str(), "wb" );
+    if( !f )
+        throw runtime_error("Could not open for writing: " + path);
+    fprintf( f, "P6\n%d %d\n255\n", w, h );
+    const bool ok = fwrite( pixels.data(), 1, pixels.size(), f ) == pixels.size();
+    if( fclose( f ) != 0 || !ok )
+        throw runtime_error("Could not write: " + path);
+}
+
+//----------------------------------------------------------------------------
+
+void FrameExporter::fillRect( vector<uint8_t>& pixels, int w, int h, int x, int y, int rw, int rh, const uint8_t* color ) {
+    const int x1 = max( x, 0 ), x2 = min( x + rw, w );
+    const int y1 = max( y, 0 ), y2 = min( y + rh, h );
+    for( int py = y1; py < y2; ++py ) {
+        uint8_t* p = &pixels[ ( size_t( py ) * w + x1 ) * 3 ];
+        for( int px = x1; px < x2; ++px, p += 3 ) {
+            p[0] = color[0];
+            p[1] = color[1];
+            p[2] = color[2];
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void FrameExporter::drawLine( vector<uint8_t>& pixels, int w, int h, int x1, int y1, int x2, int y2, int thickness, const uint8_t* color ) {
+    // Bresenham, with each point drawn as a square of the given thickness
+    const int dx = abs( x2 - x1 ), sx = x1 < x2 ? 1 : -1;
+    const int dy = -abs( y2 - y1 ), sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy;
+    while( true ) {
+        fillRect( pixels, w, h, x1 - ( thickness - 1 ) / 2, y1 - ( thickness - 1 ) / 2, thickness, thickness, color );
+        if( x1 == x2 && y1 == y2 )
+            break;
+        const int e2 = 2 * err;
+        if( e2 >= dy ) { err += dy; x1 += sx; }
+        if( e2 <= dx ) { err += dx; y1 += sy; }
+    }
+}
+
+//----------------------------------------------------------------------------
@@ -0,0 +1,57 @@
+#ifndef FRAME_EXPORTER_HPP
+#define FRAME_EXPORTER_HPP
+
+// local:
+#include "Arena.hpp"
+
+// STL:
+#include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// FrameExporter writes snapshots of an Arena to a numbered sequence of image files
+//
+// addFrame only copies the atoms and bonds, the drawing and writing is done by a pool of threads so that
+// the simulation can carry on meanwhile. The images use the same colours as MyFrame::drawArena and are
+// written in binary PPM format as <prefix>000000.ppm, <prefix>000001.ppm, etc.
+class FrameExporter {
+
+    public:
+
+        FrameExporter( const std::string& prefix, int scale = 8, int num_threads = 0 ); // 0 threads for one per core
+        ~FrameExporter(); // waits for the queued frames to be written
+
+        void addFrame( const Arena& arena ); // only waits if the threads fall too far behind
+        void finish();                       // waits for the queued frames, throwing if any could not be written
+        int getNumberOfFrames() const { return this->num_frames; }
+
+    private:
+
+        struct BondLine { int x1, y1, x2, y2; Arena::Neighborhood range; };
+        struct Snapshot { int iFrame; int width, height;
+                          std::vector<Arena::AtomSpec> atoms;
+                          std::vector<BondLine> bonds; };
+
+        const std::string               prefix;
+        const int                       scale;
+        size_t                          max_queued;
+        int                             num_frames;
+        std::deque<Snapshot>            queue;
+        size_t                          num_busy;
+        bool                            stopping;
+        std::string                     error;   // the first failure, reported by finish()
+        std::mutex                      queue_mutex;
+        std::condition_variable         work_available;
+        std::condition_variable         work_done;
+        std::vector<std::thread>        threads;
+
+        void runThread();
+        void writeFrame( const Snapshot& snapshot ) const;
+        static void drawLine( std::vector<uint8_t>& pixels, int w, int h, int x1, int y1, int x2, int y2, int thickness, const uint8_t* color );
+        static void fillRect( std::vector<uint8_t>& pixels, int w, int h, int x, int y, int rw, int rh, const uint8_t* color );
+};
+
+#endif
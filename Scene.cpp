@@ -0,0 +1,214 @@
+// local:
+#include "Scene.hpp"
+
+// stdlib:
+#include <stdlib.h>
+#include <string.h>
+
+// STL:
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+static const char SCENE_MAGIC[8] = { 'G', 'P', 'S', 'C', 'E', 'N', 'E', '1' };
+
+//----------------------------------------------------------------------------
+
+void Scene::readText( istream& in ) {
+    string line;
+    int iLine = 0;
+    while( getline( in, line ) ) {
+        iLine++;
+        const size_t iComment = line.find( '#' );
+        if( iComment != string::npos )
+            line.erase( iComment );
+        istringstream words( line );
+        string keyword;
+        if( !( words >> keyword ) )
+            continue; // blank line
+        bool ok;
+        if( keyword == "atom" ) {
+            Arena::AtomSpec atom;
+            ok = bool( words >> atom.x >> atom.y >> atom.type );
+            this->atoms.push_back( atom );
+        }
+        else if( keyword == "bond" ) {
+            Arena::BondSpec bond;
+            string range;
+            ok = bool( words >> bond.a >> bond.b >> range );
+            if( ok )
+                bond.range = Arena::getNeighborhood( range );
+            this->bonds.push_back( bond );
+        }
+        else if( keyword == "fill" ) {
+            Fill fill;
+            ok = bool( words >> fill.num_tries >> fill.min_type >> fill.max_type );
+            this->fills.push_back( fill );
+        }
+        else {
+            ostringstream error;
+            error << "Scene line " << iLine << ": unknown entry '" << keyword << "'";
+            throw runtime_error( error.str() );
+        }
+        if( !ok ) {
+            ostringstream error;
+            error << "Scene line " << iLine << ": malformed " << keyword;
+            throw runtime_error( error.str() );
+        }
+        string extra;
+        if( words >> extra ) {
+            ostringstream error;
+            error << "Scene line " << iLine << ": unexpected '" << extra << "' after " << keyword;
+            throw runtime_error( error.str() );
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void Scene::writeText( ostream& out ) const {
+    for( const Arena::AtomSpec& atom : this->atoms )
+        out << "atom " << atom.x << " " << atom.y << " " << atom.type << "\n";
+    for( const Arena::BondSpec& bond : this->bonds )
+        out << "bond " << bond.a << " " << bond.b << " " << Arena::getNeighborhoodName( bond.range ) << "\n";
+    for( const Fill& fill : this->fills )
+        out << "fill " << fill.num_tries << " " << fill.min_type << " " << fill.max_type << "\n";
+}
+
+//----------------------------------------------------------------------------
+
+void Scene::readBinary( istream& in ) {
+    char magic[8];
+    uint32_t counts[3];
+    if( !in.read( magic, sizeof( magic ) ) || memcmp( magic, SCENE_MAGIC, sizeof( magic ) ) != 0 )
+        throw runtime_error("Not a binary scene file");
+    if( !in.read( reinterpret_cast<char*>( counts ), sizeof( counts ) ) )
+        throw runtime_error("Truncated scene file");
+    // check the sizes against what is left of the file before allocating anything for them
+    const uint64_t num_values = 3 * ( uint64_t( counts[0] ) + counts[1] + counts[2] );
+    const streampos here = in.tellg();
+    if( here != streampos( -1 ) ) {
+        in.seekg( 0, ios::end );
+        const streampos end = in.tellg();
+        in.seekg( here );
+        if( end == streampos( -1 ) || uint64_t( end - here ) < num_values * sizeof( int32_t ) )
+            throw runtime_error("Truncated scene file");
+    }
+    // each section is read in one go and then unpacked
+    vector<int32_t> values( static_cast<size_t>( num_values ) );
+    if( !in.read( reinterpret_cast<char*>( values.data() ), values.size() * sizeof( int32_t ) ) )
+        throw runtime_error("Truncated scene file");
+    const int32_t *value = values.data();
+    for( uint32_t i = 0; i < counts[0]; ++i, value += 3 ) {
+        Arena::AtomSpec atom = { value[0], value[1], value[2] };
+        this->atoms.push_back( atom );
+    }
+    for( uint32_t i = 0; i < counts[1]; ++i, value += 3 ) {
+        if( value[2] < Arena::vonNeumann || value[2] > Arena::Moore2 )
+            throw runtime_error("Unknown bond range in scene file");
+        Arena::BondSpec bond = { uint32_t( value[0] ), uint32_t( value[1] ), Arena::Neighborhood( value[2] ) };
+        this->bonds.push_back( bond );
+    }
+    for( uint32_t i = 0; i < counts[2]; ++i, value += 3 ) {
+        Fill fill = { value[0], value[1], value[2] };
+        this->fills.push_back( fill );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void Scene::writeBinary( ostream& out ) const {
+    const uint32_t counts[3] = { uint32_t( this->atoms.size() ), uint32_t( this->bonds.size() ), uint32_t( this->fills.size() ) };
+    vector<int32_t> values;
+    values.reserve( 3 * ( this->atoms.size() + this->bonds.size() + this->fills.size() ) );
+    for( const Arena::AtomSpec& atom : this->atoms ) {
+        values.push_back( atom.x );
+        values.push_back( atom.y );
+        values.push_back( atom.type );
+    }
+    for( const Arena::BondSpec& bond : this->bonds ) {
+        values.push_back( int32_t( bond.a ) );
+        values.push_back( int32_t( bond.b ) );
+        values.push_back( bond.range );
+    }
+    for( const Fill& fill : this->fills ) {
+        values.push_back( fill.num_tries );
+        values.push_back( fill.min_type );
+        values.push_back( fill.max_type );
+    }
+    out.write( SCENE_MAGIC, sizeof( SCENE_MAGIC ) );
+    out.write( reinterpret_cast<const char*>( counts ), sizeof( counts ) );
+    out.write( reinterpret_cast<const char*>( values.data() ), values.size() * sizeof( int32_t ) );
+}
+
+//----------------------------------------------------------------------------
+
+void Scene::load( const string& filename ) {
+    ifstream in( filename.c_str(), ios::binary );
+    if( !in )
+        throw runtime_error("Could not open scene file: " + filename);
+    char magic[8];
+    const bool is_binary = in.read( magic, sizeof( magic ) ) && memcmp( magic, SCENE_MAGIC, sizeof( magic ) ) == 0;
+    in.clear();
+    in.seekg( 0 );
+    if( is_binary )
+        readBinary( in );
+    else
+        readText( in );
+}
+
+//----------------------------------------------------------------------------
+
+template<class Geometry>
+void Scene::addTo( ArenaT<Geometry>& arena ) const {
+    // bond indices are relative to the scene's own atoms, and are checked before anything is added
+    for( const Arena::BondSpec& bond : this->bonds ) {
+        if( bond.a >= this->atoms.size() || bond.b >= this->atoms.size() )
+            throw out_of_range("Scene bond refers to a missing atom");
+    }
+    vector<Arena::BondSpec> arena_bonds( this->bonds );
+    const size_t first = arena.addAtoms( this->atoms );
+    for( Arena::BondSpec& bond : arena_bonds ) {
+        bond.a += first;
+        bond.b += first;
+    }
+    try {
+        arena.addBonds( arena_bonds );
+    }
+    catch( ... ) {
+        // (e.g. a bond that is too long) take the atoms out again, rather than leave them without their bonds
+        for( size_t i = 0; i < this->atoms.size(); ++i )
+            arena.removeAtom( arena.getHandle( first + i ) );
+        throw;
+    }
+
+    // the random fills only use positions that are still free
+    const int X = arena.getArenaWidth();
+    const int Y = arena.getArenaHeight();
+    vector<bool> taken( size_t( X ) * Y, false );
+    vector<Arena::AtomSpec> extras;
+    for( const Fill& fill : this->fills ) {
+        if( fill.max_type < fill.min_type )
+            throw invalid_argument("Scene fill has an empty range of types");
+        for( int iTry = 0; iTry < fill.num_tries; ++iTry ) {
+            Arena::AtomSpec atom;
+            atom.x = rand() % X;
+            atom.y = rand() % Y;
+            atom.type = fill.min_type + rand() % ( fill.max_type - fill.min_type + 1 );
+            if( arena.hasAtom( atom.x, atom.y ) || taken[ size_t( atom.y ) * X + atom.x ] )
+                continue;
+            taken[ size_t( atom.y ) * X + atom.x ] = true;
+            extras.push_back( atom );
+        }
+    }
+    arena.addAtoms( extras );
+}
+
+//----------------------------------------------------------------------------
+
+template void Scene::addTo( Arena& arena ) const;
+template void Scene::addTo( Arena1024& arena ) const;
+template void Scene::addTo( Arena4096& arena ) const;
+
+//----------------------------------------------------------------------------
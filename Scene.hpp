@@ -0,0 +1,37 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+// local:
+#include "Arena.hpp"
+
+// STL:
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+// Scene describes the initial contents of an Arena
+//
+// The text format has one entry per line, with # starting a comment:
+//   atom <x> <y> <type>
+//   bond <a> <b> <range>                 (atoms numbered from 0 in the order given, range as in Arena::Neighborhood)
+//   fill <tries> <min_type> <max_type>   (adds atoms of random type at random empty positions)
+// The binary format holds the same information, in native byte order.
+class Scene {
+
+    public:
+
+        struct Fill { int num_tries; int min_type, max_type; };
+
+        std::vector<Arena::AtomSpec> atoms;
+        std::vector<Arena::BondSpec> bonds;
+        std::vector<Fill>            fills;
+
+        void readText( std::istream& in );
+        void writeText( std::ostream& out ) const;
+        void readBinary( std::istream& in );
+        void writeBinary( std::ostream& out ) const;
+        void load( const std::string& filename );  // either format
+        template<class Geometry> void addTo( ArenaT<Geometry>& arena ) const; // for the Arena typedefs
+};
+
+#endif
@@ -0,0 +1,97 @@
+// local:
+#include "Trace.hpp"
+
+// stdlib:
+#include <stdio.h>
+
+// STL:
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <ostream>
+using namespace std;
+
+atomic<bool> Trace::enabled( false );
+
+namespace {
+
+    struct Event { const char* name; uint64_t start, duration; int64_t value; };
+
+    // each thread writes only to its own buffer, so only the count needs to be atomic
+    struct Buffer {
+        static const size_t CAPACITY = 1 << 16;
+        vector<Event>    events;
+        atomic<uint64_t> num_recorded;
+        int              thread_id;
+        Buffer( int id ) : events( CAPACITY ), num_recorded( 0 ), thread_id( id ) {}
+    };
+
+    // every thread's buffer, kept after the thread exits so its events can still be written out
+    mutex                     buffers_mutex;
+    vector<unique_ptr<Buffer>> buffers;
+    thread_local Buffer*      this_thread_buffer = NULL;
+
+    const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+}
+
+//----------------------------------------------------------------------------
+
+uint64_t Trace::now() {
+    return uint64_t( chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - epoch ).count() );
+}
+
+//----------------------------------------------------------------------------
+
+void Trace::record( const char* name, uint64_t start, uint64_t end, int64_t value ) {
+    if( !this_thread_buffer ) {
+        // (only the first event on each thread takes the lock)
+        lock_guard<mutex> lock( buffers_mutex );
+        buffers.push_back( unique_ptr<Buffer>( new Buffer( int( buffers.size() ) + 1 ) ) );
+        this_thread_buffer = buffers.back().get();
+    }
+    Buffer& buffer = *this_thread_buffer;
+    const uint64_t i = buffer.num_recorded.load( memory_order_relaxed );
+    Event& e = buffer.events[ i % Buffer::CAPACITY ];
+    e.name = name;
+    e.start = start;
+    e.duration = end - start;
+    e.value = value;
+    buffer.num_recorded.store( i + 1, memory_order_release );
+}
+
+//----------------------------------------------------------------------------
+
+void Trace::writeJSON( ostream& out ) {
+    lock_guard<mutex> lock( buffers_mutex );
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for( const unique_ptr<Buffer>& buffer : buffers ) {
+        const uint64_t num_recorded = buffer->num_recorded.load( memory_order_acquire );
+        const uint64_t num_kept = min( num_recorded, uint64_t( Buffer::CAPACITY ) );
+        for( uint64_t i = num_recorded - num_kept; i < num_recorded; ++i ) {
+            const Event& e = buffer->events[ i % Buffer::CAPACITY ];
+            // timestamps are in microseconds
+            char times[64];
+            snprintf( times, sizeof( times ), "\"ts\":%.3f,\"dur\":%.3f", e.start / 1000.0, e.duration / 1000.0 );
+            out << ( first ? "\n" : ",\n" ) << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << buffer->thread_id << "," << times;
+            if( e.value >= 0 )
+                out << ",\"args\":{\"n\":" << e.value << "}";
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+}
+
+//----------------------------------------------------------------------------
+
+void Trace::clear() {
+    lock_guard<mutex> lock( buffers_mutex );
+    for( const unique_ptr<Buffer>& buffer : buffers )
+        buffer->num_recorded.store( 0, memory_order_relaxed );
+}
+
+//----------------------------------------------------------------------------
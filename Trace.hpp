@@ -0,0 +1,53 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// STL:
+#include <atomic>
+#include <iosfwd>
+#include <cstdint>
+
+// Trace records timed events for viewing on a timeline, e.g. in chrome://tracing or ui.perfetto.dev
+//
+// Wrap a block in TRACE_SCOPE("name"), or TRACE_SCOPE_VALUE("name",n) to also record a number such as
+// a size. This compiles to nothing unless GRID_PHYSICS_TRACE is defined, and then costs a single check
+// until Trace::setEnabled(true) is called. Each thread writes to its own ring buffer without locking,
+// keeping its most recent events. Call writeJSON and clear while the traced threads are idle.
+class Trace {
+
+    public:
+
+        static void setEnabled( bool enabled ) { Trace::enabled.store( enabled, std::memory_order_relaxed ); }
+        static bool isEnabled() { return Trace::enabled.load( std::memory_order_relaxed ); }
+        static void writeJSON( std::ostream& out ); // in Chrome's trace event format
+        static void clear();
+
+        class Scope {
+            public:
+                Scope( const char* name, int64_t value = -1 ) : name( isEnabled() ? name : NULL ), value( value )
+                    { if( this->name ) this->start = now(); }
+                ~Scope() { if( this->name ) record( this->name, this->start, now(), this->value ); }
+            private:
+                const char* name;   // NULL if not recording
+                int64_t     value;
+                uint64_t    start;
+        };
+
+    private:
+
+        static std::atomic<bool> enabled;
+
+        static uint64_t now(); // in nanoseconds
+        static void record( const char* name, uint64_t start, uint64_t end, int64_t value );
+};
+
+#ifdef GRID_PHYSICS_TRACE
+    #define TRACE_JOIN2( a, b ) a##b
+    #define TRACE_JOIN( a, b ) TRACE_JOIN2( a, b )
+    #define TRACE_SCOPE( name ) Trace::Scope TRACE_JOIN( trace_scope_, __LINE__ )( name )
+    #define TRACE_SCOPE_VALUE( name, value ) Trace::Scope TRACE_JOIN( trace_scope_, __LINE__ )( name, int64_t( value ) )
+#else
+    #define TRACE_SCOPE( name )
+    #define TRACE_SCOPE_VALUE( name, value )
+#endif
+
+#endif
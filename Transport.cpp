@@ -0,0 +1,135 @@
+// local:
+#include "Transport.hpp"
+
+// stdlib:
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// STL:
+#include <stdexcept>
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+SocketTransport* SocketTransport::spawn( int num_ranks ) {
+    if( num_ranks < 1 )
+        throw out_of_range("Need at least one process");
+    // connect every pair of processes before forking, so each child inherits its ends
+    vector<vector<int>> ends( num_ranks, vector<int>( num_ranks, -1 ) );
+    for( int a = 0; a < num_ranks; ++a ) {
+        for( int b = a + 1; b < num_ranks; ++b ) {
+            int fds[2];
+            if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) != 0 )
+                throw runtime_error("Could not create socket pair");
+            ends[a][b] = fds[0];
+            ends[b][a] = fds[1];
+        }
+    }
+    vector<int> children;
+    int rank = 0;
+    for( int r = 1; r < num_ranks; ++r ) {
+        const pid_t pid = fork();
+        if( pid < 0 )
+            throw runtime_error("Could not fork");
+        if( pid == 0 ) {
+            rank = r;
+            children.clear();
+            break;
+        }
+        children.push_back( int( pid ) );
+    }
+    // keep only our own ends
+    for( int a = 0; a < num_ranks; ++a ) {
+        for( int b = 0; b < num_ranks; ++b ) {
+            if( a != rank && ends[a][b] != -1 )
+                close( ends[a][b] );
+        }
+    }
+    return new SocketTransport( rank, ends[ rank ], children );
+}
+
+//----------------------------------------------------------------------------
+
+SocketTransport::SocketTransport( int rank, const vector<int>& sockets, const vector<int>& children )
+    : rank( rank )
+    , sockets( sockets )
+    , children( children )
+{
+}
+
+//----------------------------------------------------------------------------
+
+SocketTransport::~SocketTransport() {
+    for( const int& fd : this->sockets ) {
+        if( fd != -1 )
+            close( fd );
+    }
+    for( const int& pid : this->children ) {
+        int status;
+        while( waitpid( pid_t( pid ), &status, 0 ) < 0 && errno == EINTR ) {}
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void SocketTransport::send( int to, const vector<char>& message ) {
+    // each message is preceded by its length
+    const int fd = getSocket( to );
+    const uint64_t size = message.size();
+    writeAll( fd, reinterpret_cast<const char*>( &size ), sizeof( size ) );
+    writeAll( fd, message.data(), message.size() );
+}
+
+//----------------------------------------------------------------------------
+
+void SocketTransport::receive( int from, vector<char>& message ) {
+    const int fd = getSocket( from );
+    uint64_t size;
+    readAll( fd, reinterpret_cast<char*>( &size ), sizeof( size ) );
+    message.resize( size_t( size ) );
+    readAll( fd, message.data(), message.size() );
+}
+
+//----------------------------------------------------------------------------
+
+int SocketTransport::getSocket( int other ) const {
+    if( other < 0 || other >= getNumberOfRanks() || other == this->rank )
+        throw out_of_range("Invalid rank");
+    return this->sockets[ other ];
+}
+
+//----------------------------------------------------------------------------
+
+void SocketTransport::writeAll( int fd, const char* data, size_t size ) {
+    while( size > 0 ) {
+        const ssize_t n = write( fd, data, size );
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n <= 0 )
+            throw runtime_error("Could not send message");
+        data += n;
+        size -= size_t( n );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+void SocketTransport::readAll( int fd, char* data, size_t size ) {
+    while( size > 0 ) {
+        const ssize_t n = read( fd, data, size );
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n < 0 )
+            throw runtime_error("Could not receive message");
+        if( n == 0 )
+            throw runtime_error("Connection closed by the other process");
+        data += n;
+        size -= size_t( n );
+    }
+}
+
+//----------------------------------------------------------------------------
@@ -0,0 +1,51 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+// STL:
+#include <vector>
+#include <cstddef>
+
+// Transport passes messages between the processes of a distributed run, numbered 0 to N-1
+//
+// Messages between any two processes arrive in the order they were sent. send may block until the
+// receiver reads, so the two ends of a conversation must not both send large messages at once.
+class Transport {
+
+    public:
+
+        virtual ~Transport() {}
+
+        virtual int getRank() const = 0;
+        virtual int getNumberOfRanks() const = 0;
+        virtual void send( int to, const std::vector<char>& message ) = 0;
+        virtual void receive( int from, std::vector<char>& message ) = 0;
+};
+
+// SocketTransport runs the processes on one machine, connected by Unix domain sockets
+class SocketTransport : public Transport {
+
+    public:
+
+        // forks the current process into num_ranks processes and returns this one's transport
+        static SocketTransport* spawn( int num_ranks );
+        ~SocketTransport(); // rank 0 also waits for the others to exit
+
+        int getRank() const { return this->rank; }
+        int getNumberOfRanks() const { return int( this->sockets.size() ); }
+        void send( int to, const std::vector<char>& message );
+        void receive( int from, std::vector<char>& message );
+
+    private:
+
+        SocketTransport( int rank, const std::vector<int>& sockets, const std::vector<int>& children );
+
+        const int        rank;
+        std::vector<int> sockets;   // per rank, -1 for our own
+        std::vector<int> children;  // (for rank 0) the process ids of the others
+
+        int getSocket( int other ) const;
+        static void writeAll( int fd, const char* data, size_t size );
+        static void readAll( int fd, char* data, size_t size );
+};
+
+#endif
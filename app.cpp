@@ -5,6 +5,7 @@
 // STL:
 #include <cstdlib>
 #include <ctime>
+#include <string>
 using namespace std;
 
 IMPLEMENT_APP(MyApp)
@@ -16,7 +17,14 @@ bool MyApp::OnInit()
 
     srand(time(0));
 
-    MyFrame *frame = new MyFrame("Grid Physics");
+    // an optional scene file and chemistry file can be given on the command line
+    string scene_filename, chemistry_filename;
+    if( this->argc > 1 )
+        scene_filename = string( wxString( this->argv[1] ).mb_str() );
+    if( this->argc > 2 )
+        chemistry_filename = string( wxString( this->argv[2] ).mb_str() );
+
+    MyFrame *frame = new MyFrame("Grid Physics", scene_filename, chemistry_filename);
     frame->Show(true);
     return true;
 }
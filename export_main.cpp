@@ -0,0 +1,71 @@
+// grid_physics_export runs a world without a window, writing snapshots of it as images (see FrameExporter)
+//
+// usage: grid_physics_export <width> <height> <steps> <every> <prefix> [<scene file> [<chemistry file>]]
+//
+// A frame is written before the first step and then after every <every> steps.
+
+// local:
+#include "Arena.hpp"
+#include "Chemistry.hpp"
+#include "FrameExporter.hpp"
+#include "Scene.hpp"
+
+// stdlib:
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// STL:
+#include <stdexcept>
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+int main( int argc, char* argv[] ) {
+    if( argc < 6 ) {
+        fprintf( stderr, "usage: %s <width> <height> <steps> <every> <prefix> [<scene file> [<chemistry file>]]\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    try {
+        const int width = atoi( argv[1] );
+        const int height = atoi( argv[2] );
+        const int num_steps = atoi( argv[3] );
+        const int export_every = atoi( argv[4] );
+        if( export_every < 1 )
+            throw out_of_range("Frames must be written at least every step");
+        Scene scene;
+        if( argc > 6 ) {
+            scene.load( argv[6] );
+        }
+        else {
+            const Scene::Fill fill = { width * height / 4, 0, 5 };
+            scene.fills.push_back( fill );
+        }
+
+        srand( unsigned( time( 0 ) ) );
+        Arena arena( width, height );
+        scene.addTo( arena );
+        // otherwise the arena keeps the default chemistry
+        if( argc > 7 ) {
+            Chemistry chemistry;
+            chemistry.load( argv[7] );
+            arena.setChemistry( chemistry );
+        }
+
+        // the exporter works in the background so this doesn't hold up the simulation
+        FrameExporter exporter( argv[5] );
+        exporter.addFrame( arena );
+        for( int step = 1; step <= num_steps; ++step ) {
+            arena.update();
+            if( step % export_every == 0 )
+                exporter.addFrame( arena );
+        }
+        exporter.finish();
+        printf( "wrote %d frames\n", exporter.getNumberOfFrames() );
+    }
+    catch( exception& e ) {
+        fprintf( stderr, "%s\n", e.what() );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
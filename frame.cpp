@@ -1,10 +1,15 @@
 // local:
 #include "frame.hpp"
+#include "Scene.hpp"
+#include "Chemistry.hpp"
+#include "Trace.hpp"
 
 // wxWidgets:
 #include <wx/dcbuffer.h>
 
 // STL:
+#include <sstream>
+#include <fstream>
 using namespace std;
 
 namespace ID
@@ -19,6 +24,8 @@ namespace ID
         SpeedMedium,
         SpeedFast,
         Step,
+        ExportFrames,
+        RecordTrace,
     };
 };
 
@@ -30,6 +37,8 @@ wxBEGIN_EVENT_TABLE(MyFrame, wxFrame)
     EVT_MENU(ID::SpeedMedium, MyFrame::OnSpeedMedium)
     EVT_MENU(ID::SpeedFast, MyFrame::OnSpeedFast)
     EVT_MENU(ID::Step, MyFrame::OnStep)
+    EVT_MENU(ID::ExportFrames, MyFrame::OnExportFrames)
+    EVT_MENU(ID::RecordTrace, MyFrame::OnRecordTrace)
     EVT_PAINT(MyFrame::OnPaint)
     EVT_SIZE(MyFrame::OnSize)
     EVT_IDLE(MyFrame::OnIdle)
@@ -37,11 +46,14 @@ wxEND_EVENT_TABLE()
 
 //-------------------------------------------------------------------------------------
 
-MyFrame::MyFrame(const wxString& title)
+MyFrame::MyFrame(const wxString& title, const string& scene_filename, const string& chemistry_filename)
        : wxFrame(NULL, wxID_ANY, title, wxDefaultPosition, wxSize(900,700) )
        , arena( 80, 60 )
+       , scene_filename( scene_filename )
+       , chemistry_filename( chemistry_filename )
        , iterations( 0 )
        , render_every( 1 )
+       , export_every( 10 )
 {
     SetIcon(wxICON(sample));
 
@@ -55,6 +67,11 @@ MyFrame::MyFrame(const wxString& title)
     actionMenu->Append(ID::SpeedMedium, "Run at medium speed\t2", "Run at a medium speed");
     actionMenu->Append(ID::SpeedFast, "Run at fast speed\t3", "Run at a fast speed");
     actionMenu->Append(ID::Step, "Step\tSPACE", "Advance forwards by a single step");
+    actionMenu->AppendSeparator();
+    actionMenu->AppendCheckItem(ID::ExportFrames, "Export frames\tE", "Write every 10th step to numbered image files in the current folder");
+#ifdef GRID_PHYSICS_TRACE
+    actionMenu->AppendCheckItem(ID::RecordTrace, "Record trace\tT", "Record the timings of each step, written to trace.json when stopped");
+#endif
 
     wxMenu *helpMenu = new wxMenu;
     helpMenu->Append(wxID_ABOUT, "&About\tF1", "Show about dialog");
@@ -74,119 +91,146 @@ MyFrame::MyFrame(const wxString& title)
 
 //-------------------------------------------------------------------------------------
 
+// the scene used when none is given on the command line
+static const char* default_scene =
+    "# an 8-cell loop with some rigid sections\n"
+    "atom 1 1 0\n"
+    "atom 2 1 0\n"
+    "atom 2 2 0\n"
+    "atom 1 2 0\n"
+    "atom 1 3 0\n"
+    "atom 0 3 0\n"
+    "atom 0 2 0\n"
+    "atom 0 1 0\n"
+    "bond 0 1 vonNeumann\n"
+    "bond 1 2 vonNeumann\n"
+    "bond 2 3 Moore\n"
+    "bond 3 4 Moore\n"
+    "bond 4 5 vonNeumann\n"
+    "bond 5 6 Moore\n"
+    "bond 6 7 vonNeumann\n"
+    "bond 7 0 Moore\n"
+    "# a box with flailing arms\n"
+    "atom 10 10 1\n"
+    "atom 11 10 1\n"
+    "atom 12 10 1\n"
+    "atom 12 11 1\n"
+    "atom 11 11 1\n"
+    "atom 10 11 1\n"
+    "atom 10 12 1\n"
+    "atom 11 12 1\n"
+    "atom 12 12 1\n"
+    "atom 9 9 1\n"
+    "atom 8 8 1\n"
+    "atom 7 7 1\n"
+    "atom 11 9 1\n"
+    "atom 12 8 1\n"
+    "atom 13 7 1\n"
+    "bond 8 9 vonNeumann\n"
+    "bond 9 10 vonNeumann\n"
+    "bond 10 11 vonNeumann\n"
+    "bond 11 12 vonNeumann\n"
+    "bond 12 13 vonNeumann\n"
+    "bond 13 14 vonNeumann\n"
+    "bond 14 15 vonNeumann\n"
+    "bond 15 16 vonNeumann\n"
+    "bond 8 17 Moore\n"
+    "bond 17 18 Moore\n"
+    "bond 18 19 Moore\n"
+    "bond 10 20 Moore\n"
+    "bond 20 21 Moore\n"
+    "bond 21 22 Moore\n"
+    "# a double-stranded molecule\n"
+    "atom 21 21 5\n"
+    "atom 22 21 3\n"
+    "atom 21 22 5\n"
+    "atom 22 22 3\n"
+    "atom 21 23 5\n"
+    "atom 22 23 3\n"
+    "atom 21 24 5\n"
+    "atom 22 24 3\n"
+    "atom 21 25 5\n"
+    "atom 22 25 3\n"
+    "atom 21 26 5\n"
+    "atom 22 26 3\n"
+    "bond 23 24 Moore\n"
+    "bond 25 26 Moore\n"
+    "bond 27 28 Moore\n"
+    "bond 29 30 Moore\n"
+    "bond 31 32 Moore\n"
+    "bond 33 34 Moore\n"
+    "bond 23 25 Moore\n"
+    "bond 24 26 Moore\n"
+    "bond 25 27 Moore\n"
+    "bond 26 28 Moore\n"
+    "bond 27 29 Moore\n"
+    "bond 28 30 Moore\n"
+    "bond 29 31 Moore\n"
+    "bond 30 32 Moore\n"
+    "bond 31 33 Moore\n"
+    "bond 32 34 Moore\n"
+    "# a longer chain\n"
+    "atom 31 0 2\n"
+    "atom 32 0 2\n"
+    "atom 31 1 2\n"
+    "atom 32 1 2\n"
+    "atom 31 2 2\n"
+    "atom 32 2 2\n"
+    "atom 31 3 2\n"
+    "atom 32 3 2\n"
+    "atom 31 4 2\n"
+    "atom 32 4 2\n"
+    "atom 31 5 2\n"
+    "atom 32 5 2\n"
+    "atom 31 6 2\n"
+    "atom 32 6 2\n"
+    "atom 31 7 2\n"
+    "atom 32 7 2\n"
+    "atom 31 8 2\n"
+    "atom 32 8 2\n"
+    "atom 31 9 2\n"
+    "atom 32 9 2\n"
+    "bond 35 36 Moore\n"
+    "bond 35 37 Moore\n"
+    "bond 36 38 Moore\n"
+    "bond 37 39 Moore\n"
+    "bond 38 40 Moore\n"
+    "bond 39 41 Moore\n"
+    "bond 40 42 Moore\n"
+    "bond 41 43 Moore\n"
+    "bond 42 44 Moore\n"
+    "bond 43 45 Moore\n"
+    "bond 44 46 Moore\n"
+    "bond 45 47 Moore\n"
+    "bond 46 48 Moore\n"
+    "bond 47 49 Moore\n"
+    "bond 48 50 Moore\n"
+    "bond 49 51 Moore\n"
+    "bond 50 52 Moore\n"
+    "bond 51 53 Moore\n"
+    "bond 52 54 Moore\n"
+    "# some surrounding atoms\n"
+    "fill 500 0 5\n";
+
+//-------------------------------------------------------------------------------------
+
 void MyFrame::seed() {
 
-    Arena::Neighborhood bond_range = Arena::Neighborhood::Moore;
     try {
-        // an 8-cell loop with some rigid sections
-        if( 1 ) {
-            size_t a = arena.addAtom( 1, 1, 0 );
-            size_t b = arena.addAtom( 2, 1, 0 );
-            size_t c = arena.addAtom( 2, 2, 0 );
-            size_t d = arena.addAtom( 1, 2, 0 );
-            size_t e = arena.addAtom( 1, 3, 0 );
-            size_t f = arena.addAtom( 0, 3, 0 );
-            size_t g = arena.addAtom( 0, 2, 0 );
-            size_t h = arena.addAtom( 0, 1, 0 );
-            arena.makeBond( a, b, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( b, c, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( c, d, Arena::Neighborhood::Moore );
-            arena.makeBond( d, e, Arena::Neighborhood::Moore );
-            arena.makeBond( e, f, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( f, g, Arena::Neighborhood::Moore );
-            arena.makeBond( g, h, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( h, a, Arena::Neighborhood::Moore );
+        Scene scene;
+        if( this->scene_filename.empty() ) {
+            istringstream in( default_scene );
+            scene.readText( in );
         }
-    
-        // a box with flailing arms
-        if( 1 ) {
-            size_t a = arena.addAtom( 10, 10, 1 );
-            size_t b = arena.addAtom( 11, 10, 1 );
-            size_t c = arena.addAtom( 12, 10, 1 );
-            size_t d = arena.addAtom( 12, 11, 1 );
-            size_t e = arena.addAtom( 11, 11, 1 );
-            size_t f = arena.addAtom( 10, 11, 1 );
-            size_t g = arena.addAtom( 10, 12, 1 );
-            size_t h = arena.addAtom( 11, 12, 1 );
-            size_t i = arena.addAtom( 12, 12, 1 );
-            size_t j = arena.addAtom( 9, 9, 1 );
-            size_t k = arena.addAtom( 8, 8, 1 );
-            size_t l = arena.addAtom( 7, 7, 1 );
-            size_t m = arena.addAtom( 11, 9, 1 );
-            size_t n = arena.addAtom( 12, 8, 1 );
-            size_t o = arena.addAtom( 13, 7, 1 );
-            arena.makeBond( a, b, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( b, c, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( c, d, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( d, e, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( e, f, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( f, g, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( g, h, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( h, i, Arena::Neighborhood::vonNeumann );
-            arena.makeBond( a, j, Arena::Neighborhood::Moore );
-            arena.makeBond( j, k, Arena::Neighborhood::Moore );
-            arena.makeBond( k, l, Arena::Neighborhood::Moore );
-            arena.makeBond( c, m, Arena::Neighborhood::Moore );
-            arena.makeBond( m, n, Arena::Neighborhood::Moore );
-            arena.makeBond( n, o, Arena::Neighborhood::Moore );
+        else {
+            scene.load( this->scene_filename );
         }
-
-        // a double-stranded molecule
-        if( 1 ) {
-            size_t a = arena.addAtom( 21, 21, 5 );
-            size_t b = arena.addAtom( 22, 21, 3 );
-            size_t c = arena.addAtom( 21, 22, 5 );
-            size_t d = arena.addAtom( 22, 22, 3 );
-            size_t e = arena.addAtom( 21, 23, 5 );
-            size_t f = arena.addAtom( 22, 23, 3 );
-            size_t g = arena.addAtom( 21, 24, 5 );
-            size_t h = arena.addAtom( 22, 24, 3 );
-            size_t i = arena.addAtom( 21, 25, 5 );
-            size_t j = arena.addAtom( 22, 25, 3 );
-            size_t k = arena.addAtom( 21, 26, 5 );
-            size_t l = arena.addAtom( 22, 26, 3 );
-            arena.makeBond( a, b, bond_range );
-            arena.makeBond( c, d, bond_range );
-            arena.makeBond( e, f, bond_range );
-            arena.makeBond( g, h, bond_range );
-            arena.makeBond( i, j, bond_range );
-            arena.makeBond( k, l, bond_range );
-            arena.makeBond( a, c, bond_range );
-            arena.makeBond( b, d, bond_range );
-            arena.makeBond( c, e, bond_range );
-            arena.makeBond( d, f, bond_range );
-            arena.makeBond( e, g, bond_range );
-            arena.makeBond( f, h, bond_range );
-            arena.makeBond( g, i, bond_range );
-            arena.makeBond( h, j, bond_range );
-            arena.makeBond( i, k, bond_range );
-            arena.makeBond( j, l, bond_range );
-        }
-
-        if( 1 ) { 
-            // a longer chain
-            const int N = 10;
-            size_t a = arena.addAtom( 31, 0, 2 );
-            size_t b = arena.addAtom( 32, 0, 2 );
-            arena.makeBond( a, b, bond_range );
-            for( int i = 1; i < N; ++i ) {
-                size_t a2 = arena.addAtom( 31, i, 2 );
-                size_t b2 = arena.addAtom( 32, i, 2 );
-                arena.makeBond( a, a2, bond_range );
-                arena.makeBond( b, b2, bond_range );
-                a = a2;
-                b = b2;
-            }
-        }
-    
-        if( 1 ) {
-            // add some surrounding atoms
-            for( int i = 0; i < 500; ++i ) {
-                int x = rand() % this->arena.getArenaWidth();
-                int y = rand() % this->arena.getArenaHeight();
-                if( !this->arena.hasAtom( x, y ) )
-                    this->arena.addAtom( x, y, rand() % 6 );
-            }
+        scene.addTo( this->arena );
+        // otherwise the arena keeps the default chemistry
+        if( !this->chemistry_filename.empty() ) {
+            Chemistry chemistry;
+            chemistry.load( this->chemistry_filename );
+            this->arena.setChemistry( chemistry );
         }
     }
     catch( exception& e ) {
@@ -254,6 +298,7 @@ void MyFrame::drawArena( wxGraphicsContext* pGC, int scale ) {
     pGC->SetPen(*wxMEDIUM_GREY_PEN);
     pGC->SetBrush(*wxLIGHT_GREY_BRUSH);
     for( size_t iAtom = 0; iAtom < this->arena.getNumberOfAtoms(); ++iAtom ) {
+        if( !this->arena.isLiveAtom( iAtom ) ) continue;
         Arena::Atom a = this->arena.getAtom( iAtom );
         switch( a.type ) {
             default:
@@ -271,6 +316,7 @@ void MyFrame::drawArena( wxGraphicsContext* pGC, int scale ) {
     wxPen thinBondPen(*wxBLACK,1);
     wxPen thickBondPen(*wxBLACK,2);
     for( size_t iAtom = 0; iAtom < this->arena.getNumberOfAtoms(); ++iAtom ) {
+        if( !this->arena.isLiveAtom( iAtom ) ) continue;
         Arena::Atom a = this->arena.getAtom( iAtom );
         for( const Arena::Bond& bond : a.bonds ) {
             const size_t iAtom2 = bond.iAtom;
@@ -303,28 +349,72 @@ void MyFrame::OnSize(wxSizeEvent& event) {
 void MyFrame::OnIdle(wxIdleEvent& event) {
     if( render_every == 0 ) return;
 
+    step();
+    if( iterations % this->render_every == 0 )
+        this->Refresh( false );
+    event.RequestMore(); // render continuously, not only once on idle
+}
+
+//-------------------------------------------------------------------------------------
+
+void MyFrame::OnStep(wxCommandEvent& WXUNUSED(event)) {
+    step();
+    this->render_every = 0;
+    this->Refresh(false);
+}
+
+//-------------------------------------------------------------------------------------
+
+void MyFrame::step() {
     try {
         this->arena.update();
+        // the exporter works in the background so this doesn't hold up the simulation
+        if( this->exporter && this->iterations % this->export_every == 0 )
+            this->exporter->addFrame( this->arena );
     }
     catch( exception& e ) {
         wxMessageBox( e.what() );
     }
     this->iterations++;
-    if( iterations % this->render_every == 0 )
-        this->Refresh( false );
-    event.RequestMore(); // render continuously, not only once on idle
 }
 
 //-------------------------------------------------------------------------------------
 
-void MyFrame::OnStep(wxCommandEvent& WXUNUSED(event)) {
+void MyFrame::OnExportFrames(wxCommandEvent& event) {
     try {
-        this->arena.update();
+        if( event.IsChecked() ) {
+            this->exporter.reset( new FrameExporter( "frame_" ) );
+        }
+        else if( this->exporter ) {
+            this->exporter->finish();
+            this->exporter.reset();
+        }
     }
     catch( exception& e ) {
+        this->exporter.reset();
         wxMessageBox( e.what() );
     }
-    this->iterations++;
-    this->render_every = 0;
-    this->Refresh(false);
+}
+
+//-------------------------------------------------------------------------------------
+
+void MyFrame::OnRecordTrace(wxCommandEvent& event) {
+    if( event.IsChecked() ) {
+        Trace::clear();
+        Trace::setEnabled( true );
+        return;
+    }
+    Trace::setEnabled( false );
+    try {
+        // (the exporter's threads might still be busy)
+        if( this->exporter )
+            this->exporter->finish();
+    }
+    catch( exception& e ) {
+        wxMessageBox( e.what() );
+    }
+    ofstream out( "trace.json" );
+    Trace::writeJSON( out );
+    if( !out )
+        wxMessageBox( "Could not write trace.json" );
 }
@@ -1,5 +1,6 @@
 // local:
 #include "Arena.hpp"
+#include "FrameExporter.hpp"
 
 // For compilers that support precompilation, includes "wx/wx.h".
 #include "wx/wxprec.h"
@@ -15,10 +16,14 @@
 #endif
 #include <wx/graphics.h>
 
+// STL:
+#include <string>
+#include <memory>
+
 class MyFrame : public wxFrame
 {
 public:
-    MyFrame(const wxString& title);
+    MyFrame(const wxString& title, const std::string& scene_filename, const std::string& chemistry_filename);
 
     void OnQuit(wxCommandEvent& event);
     void OnAbout(wxCommandEvent& event);
@@ -30,13 +35,21 @@ public:
     void OnSpeedMedium(wxCommandEvent& WXUNUSED(event)) { this->render_every = 100; }
     void OnSpeedFast(wxCommandEvent& WXUNUSED(event)) { this->render_every = 1000; }
     void OnStep(wxCommandEvent& WXUNUSED(event));
+    void OnExportFrames(wxCommandEvent& event);
+    void OnRecordTrace(wxCommandEvent& event);
 
 private:
     wxDECLARE_EVENT_TABLE();
 
     Arena arena;
+    std::string scene_filename;
+    std::string chemistry_filename;
     int iterations;
     int render_every;
+    std::unique_ptr<FrameExporter> exporter; // while exporting
+    int export_every;
+
+    void step();
 
     void seed();
     void draw( wxGraphicsContext *pGC, int X, int Y );
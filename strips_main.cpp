@@ -0,0 +1,81 @@
+// grid_physics_strips runs a world split into strips across several processes on this machine, without a window
+//
+// usage: grid_physics_strips <processes> <width> <height> <steps> [<scene file>]
+
+// local:
+#include "DomainStrip.hpp"
+#include "Scene.hpp"
+#include "Transport.hpp"
+
+// stdlib:
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// STL:
+#include <stdexcept>
+#include <memory>
+using namespace std;
+
+//----------------------------------------------------------------------------
+
+static size_t getTotalNumberOfAtoms( Transport& transport, const DomainStrip& strip ) {
+    // gathered on rank 0
+    uint64_t n = strip.getNumberOfOwnedAtoms();
+    vector<char> message( sizeof( n ) );
+    if( transport.getRank() != 0 ) {
+        memcpy( message.data(), &n, sizeof( n ) );
+        transport.send( 0, message );
+        return 0;
+    }
+    for( int rank = 1; rank < transport.getNumberOfRanks(); ++rank ) {
+        uint64_t n_other;
+        transport.receive( rank, message );
+        memcpy( &n_other, message.data(), sizeof( n_other ) );
+        n += n_other;
+    }
+    return size_t( n );
+}
+
+//----------------------------------------------------------------------------
+
+int main( int argc, char* argv[] ) {
+    if( argc < 5 ) {
+        fprintf( stderr, "usage: %s <processes> <width> <height> <steps> [<scene file>]\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    try {
+        const int num_processes = atoi( argv[1] );
+        const int width = atoi( argv[2] );
+        const int height = atoi( argv[3] );
+        const int num_steps = atoi( argv[4] );
+        Scene scene;
+        if( argc > 5 ) {
+            scene.load( argv[5] );
+        }
+        else {
+            const Scene::Fill fill = { width * height / 4, 0, 5 };
+            scene.fills.push_back( fill );
+        }
+
+        unique_ptr<SocketTransport> transport( SocketTransport::spawn( num_processes ) );
+        srand( unsigned( time( 0 ) ) + transport->getRank() ); // (each process needs its own random numbers)
+        DomainStrip strip( *transport, width, height );
+        strip.load( scene );
+        for( int step = 0; step <= num_steps; ++step ) {
+            if( step % 100 == 0 || step == num_steps ) {
+                const size_t num_atoms = getTotalNumberOfAtoms( *transport, strip );
+                if( transport->getRank() == 0 )
+                    printf( "step %d: %zu atoms\n", step, num_atoms );
+            }
+            if( step < num_steps )
+                strip.update();
+        }
+    }
+    catch( exception& e ) {
+        fprintf( stderr, "%s\n", e.what() );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}